@@ -52,17 +52,22 @@ int main()
                           ews::containment_mode::substring,
                           ews::containment_comparison::ignore_case);
 
-        auto item_ids = service.find_item(drafts, search_expression);
+        // Request the subjects right away instead of issuing a GetItem
+        // for each message found
+        auto page = service.find_messages(
+            ews::indexed_page_item_view(100), drafts, search_expression,
+            ews::base_shape::id_only,
+            std::vector<ews::property_path>(
+                1, ews::item_property_path::subject));
 
-        if (item_ids.empty())
+        if (page.items().empty())
         {
             std::cout << "No messages found!\n";
         }
         else
         {
-            for (const auto& id : item_ids)
+            for (const auto& msg : page.items())
             {
-                auto msg = service.get_message(id);
                 std::cout << msg.get_subject() << std::endl;
             }
         }
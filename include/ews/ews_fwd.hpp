@@ -23,16 +23,26 @@
 #define EWS_NOEXCEPT
 #endif
 
+#ifdef EWS_HAS_CONSTEXPR
+#define EWS_CONSTEXPR constexpr
+#else
+#define EWS_CONSTEXPR
+#endif
+
 // Forward declarations
 namespace ews
 {
 class and_;
+class async_engine;
 class attachment;
 class attachment_id;
 class attendee;
 class basic_credentials;
 class body;
 class calendar_item;
+class cancellation_token;
+class cancelled_error;
+class connecting_sid;
 class contact;
 class contains;
 class date_time;
@@ -40,8 +50,18 @@ class distinguished_folder_id;
 class duration;
 class exception;
 class exchange_error;
+class export_checkpoint;
+class export_sink;
+class field_order;
+class find_item_pager;
+class find_folder_result;
+class find_item_result;
+class folder;
+class folder_change;
 class folder_id;
+class fractional_page_item_view;
 class http_error;
+class indexed_page_item_view;
 class indexed_property_path;
 class internet_message_header;
 class is_equal_to;
@@ -51,24 +71,47 @@ class is_less_than;
 class is_less_than_or_equal_to;
 class is_not_equal_to;
 class item;
+class item_change;
 class item_id;
 class mailbox;
 class message;
 class mime_content;
 class not_;
+class notification;
+class notification_event;
 class ntlm_credentials;
 class or_;
 class parse_error;
 class property;
+class prepared_search_expression;
 class property_path;
+class request_limiter;
+class request_observer;
 class schema_validation_error;
 class search_expression;
+class search_parameter;
+class server_busy_error;
 class soap_fault;
+class subscription;
+class sync_folder_hierarchy_result;
+class sync_folder_items_result;
 class task;
 class update;
 struct autodiscover_result;
 struct autodiscover_hints;
+struct batch_options;
+struct export_options;
+struct export_statistics;
+struct request_metrics;
+struct retry_policy;
+struct transport_options;
+template <typename T> class basic_autodiscover_resolver;
+template <typename T> class basic_folder_resolver;
+template <typename T> class basic_mailbox_exporter;
 template <typename T> class basic_service;
+template <typename T> class basic_service_pool;
+template <typename T> class find_item_page;
+template <typename T> class item_result;
 bool operator==(const date_time&, const date_time&);
 bool operator==(const property_path&, const property_path&);
 void set_up() EWS_NOEXCEPT;
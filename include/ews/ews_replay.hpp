@@ -0,0 +1,635 @@
+//   Copyright 2016 otris software AG
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//   This project is hosted at https://github.com/otris
+
+// Request handlers that record the traffic of a service and replay it
+// later, without a server. See replay_log.
+#pragma once
+
+#include "ews.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ews
+{
+//! A request and the response the server sent for it
+struct recorded_exchange
+{
+    recorded_exchange() : request(), code(0L), response() {}
+
+    recorded_exchange(std::string req, long status, std::vector<char> resp)
+        : request(std::move(req)), code(status), response(std::move(resp))
+    {
+    }
+
+    //! The complete SOAP envelope that was sent
+    std::string request;
+
+    //! The HTTP status code of the response
+    long code;
+
+    //! The body of the response, without a terminating zero
+    std::vector<char> response;
+};
+
+//! \brief How a replay_request_handler answers requests
+struct replay_options
+{
+    replay_options()
+        : latency(0), jitter(0), max_concurrent_requests(0U), strict(false)
+    {
+    }
+
+    //! Time each response takes, as if it came over the network
+    std::chrono::microseconds latency;
+
+    //! Up to this much is added to latency, uniformly distributed
+    std::chrono::microseconds jitter;
+
+    //! \brief Number of requests that are answered at the same time.
+    //!
+    //! Others wait, like at a server with that many worker threads. \c 0,
+    //! the default, means no limit.
+    std::size_t max_concurrent_requests;
+
+    //! \brief Whether only exact matches are answered.
+    //!
+    //! By default, a request that was never recorded is answered with
+    //! one of the responses recorded for the same operation, e.g.,
+    //! \<GetItem/>, in turn.
+    bool strict;
+};
+
+//! \brief A thread-safe collection of recorded request/response pairs
+//!
+//! Request handlers are created by basic_service from nothing but the
+//! server's URL, so logs are installed for a URL:
+//!
+//! \code{.cpp}
+//! auto log = std::make_shared<ews::replay_log>();
+//! ews::replay_log::install(url, log);
+//!
+//! // Record real traffic
+//! ews::basic_service<ews::recording_request_handler> live(url, ...);
+//! live.get_message(id);
+//! std::ofstream out("traffic.ewsreplay", std::ios::binary);
+//! log->save(out);
+//!
+//! // Later, without a server
+//! ews::basic_service<ews::replay_request_handler> replayed(url, ...);
+//! replayed.get_message(id);
+//! \endcode
+class replay_log final
+{
+public:
+    replay_log()
+        : mutex_(), exchanges_(), by_request_(), by_operation_(), options_(),
+          limiter_()
+    {
+    }
+
+#ifdef EWS_HAS_DEFAULT_AND_DELETE
+    replay_log(const replay_log&) = delete;
+    replay_log& operator=(const replay_log&) = delete;
+#else
+private:
+    replay_log(const replay_log&);            // Never defined
+    replay_log& operator=(const replay_log&); // Never defined
+
+public:
+#endif
+
+    //! Makes request handlers for \p url use given log
+    static void install(const std::string& url,
+                        std::shared_ptr<replay_log> log)
+    {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.logs[url] = std::move(log);
+    }
+
+    //! Removes the log for \p url
+    static void uninstall(const std::string& url)
+    {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.logs.erase(url);
+    }
+
+    //! \brief Returns the log installed for \p url.
+    //!
+    //! Throws ews::exception if there is none.
+    static std::shared_ptr<replay_log> lookup(const std::string& url)
+    {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        auto it = reg.logs.find(url);
+        if (it == reg.logs.end())
+        {
+            throw exception("No replay log installed for " + url);
+        }
+        return it->second;
+    }
+
+    //! Adds an exchange; the first response recorded for a request wins
+    void add(recorded_exchange exchange)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto index = exchanges_.size();
+        by_request_.emplace(exchange.request, index);
+        auto& ops = by_operation_[operation_of(exchange.request)];
+        ops.indices.push_back(index);
+        exchanges_.emplace_back(
+            std::make_shared<const recorded_exchange>(std::move(exchange)));
+    }
+
+    //! Returns the number of recorded exchanges
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return exchanges_.size();
+    }
+
+    //! Returns the recorded exchange at given position
+    std::shared_ptr<const recorded_exchange> at(std::size_t index) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index >= exchanges_.size())
+        {
+            throw exception("Replay log index out of range");
+        }
+        return exchanges_[index];
+    }
+
+    //! \brief Returns the recorded exchange that answers \p request.
+    //!
+    //! Throws ews::exception if there is none; see replay_options::strict.
+    std::shared_ptr<const recorded_exchange>
+    find(const std::string& request)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = by_request_.find(request);
+        if (it != by_request_.end())
+        {
+            return exchanges_[it->second];
+        }
+
+        const auto operation = operation_of(request);
+        auto ops = by_operation_.find(operation);
+        if (options_.strict || ops == by_operation_.end())
+        {
+            throw exception("No recorded response for <" + operation + "/>");
+        }
+        auto& entry = ops->second;
+        const auto index = entry.indices[entry.next++ % entry.indices.size()];
+        return exchanges_[index];
+    }
+
+    void set_options(const replay_options& options)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        options_ = options;
+        if (options.max_concurrent_requests != 0U)
+        {
+            limiter_ = std::make_shared<request_limiter>(
+                options.max_concurrent_requests);
+        }
+        else
+        {
+            limiter_.reset();
+        }
+    }
+
+    replay_options get_options() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return options_;
+    }
+
+    //! \brief Writes all exchanges to \p os.
+    //!
+    //! Binary-safe: each exchange is a line
+    //! <tt>code request-size response-size</tt> followed by the request and
+    //! the response.
+    void save(std::ostream& os) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        os << "EWSREPLAY 1\n";
+        for (const auto& ex : exchanges_)
+        {
+            os << ex->code << ' ' << ex->request.size() << ' '
+               << ex->response.size() << '\n';
+            os.write(ex->request.data(),
+                     static_cast<std::streamsize>(ex->request.size()));
+            os.write(ex->response.data(),
+                     static_cast<std::streamsize>(ex->response.size()));
+        }
+    }
+
+    //! \brief Adds all exchanges written by save() from \p is.
+    //!
+    //! Throws ews::exception if \p is does not hold a saved log.
+    void load(std::istream& is)
+    {
+        std::string magic;
+        std::getline(is, magic);
+        if (magic != "EWSREPLAY 1")
+        {
+            throw exception("Not a replay log");
+        }
+        long code = 0L;
+        std::size_t request_size = 0U;
+        std::size_t response_size = 0U;
+        while (is >> code >> request_size >> response_size)
+        {
+            if (is.get() != '\n')
+            {
+                throw exception("Corrupt replay log");
+            }
+            recorded_exchange ex;
+            ex.code = code;
+            ex.request.resize(request_size);
+            ex.response.resize(response_size);
+            is.read(&ex.request[0],
+                    static_cast<std::streamsize>(request_size));
+            is.read(ex.response.data(),
+                    static_cast<std::streamsize>(response_size));
+            if (!is)
+            {
+                throw exception("Truncated replay log");
+            }
+            add(std::move(ex));
+        }
+    }
+
+    // Holds back the calling thread like a server that takes latency plus
+    // jitter for each request and serves max_concurrent_requests at once
+    void simulate_latency()
+    {
+        std::shared_ptr<request_limiter> limiter;
+        replay_options options;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            limiter = limiter_;
+            options = options_;
+        }
+        internal::limiter_slot slot(limiter.get());
+        auto delay = options.latency;
+        if (options.jitter.count() > 0)
+        {
+            delay += std::chrono::microseconds(static_cast<long long>(
+                internal::backoff_jitter() *
+                static_cast<double>(options.jitter.count())));
+        }
+        if (delay.count() > 0)
+        {
+            std::this_thread::sleep_for(delay);
+        }
+    }
+
+    //! Returns the name of the operation in given SOAP envelope
+    static std::string operation_of(const std::string& envelope)
+    {
+        auto body = envelope.find("Body>");
+        return internal::operation_name(
+            body == std::string::npos ? envelope : envelope.substr(body + 5U));
+    }
+
+private:
+    struct operation_entry
+    {
+        operation_entry() : indices(), next(0U) {}
+
+        std::vector<std::size_t> indices;
+        std::size_t next;
+    };
+
+    struct log_registry
+    {
+        std::mutex mutex;
+        std::map<std::string, std::shared_ptr<replay_log>> logs;
+    };
+
+    static log_registry& registry()
+    {
+        static log_registry reg;
+        return reg;
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<const recorded_exchange>> exchanges_;
+    std::unordered_map<std::string, std::size_t> by_request_;
+    std::map<std::string, operation_entry> by_operation_;
+    replay_options options_;
+    std::shared_ptr<request_limiter> limiter_;
+};
+
+//! \brief A RequestHandler that sends requests to the server and records
+//! every request and response in the replay_log installed for its URL
+//!
+//! Use as the RequestHandler of basic_service. Requests that fail without
+//! a response are not recorded.
+template <typename InnerHandler = internal::http_request>
+class basic_recording_request_handler final
+{
+public:
+    typedef typename InnerHandler::method method;
+
+    explicit basic_recording_request_handler(const std::string& url)
+        : inner_(url), log_(replay_log::lookup(url))
+    {
+    }
+
+    void set_method(method m) { inner_.set_method(m); }
+
+    void set_content_type(const std::string& content_type)
+    {
+        inner_.set_content_type(content_type);
+    }
+
+    void set_content_length(std::size_t content_length)
+    {
+        inner_.set_content_length(content_length);
+    }
+
+    void set_credentials(const internal::credentials& creds)
+    {
+        inner_.set_credentials(creds);
+    }
+
+    void set_transport_options(const transport_options& options)
+    {
+        inner_.set_transport_options(options);
+    }
+
+    void set_timeout(std::chrono::milliseconds timeout)
+    {
+        inner_.set_timeout(timeout);
+    }
+
+    void set_cancellation_token(const cancellation_token& token)
+    {
+        inner_.set_cancellation_token(token);
+    }
+
+    void reset_cancellation_token() { inner_.reset_cancellation_token(); }
+
+    void set_header(const std::string& name, const std::string& value)
+    {
+        inner_.set_header(name, value);
+    }
+
+#ifdef EWS_HAS_VARIADIC_TEMPLATES
+    template <typename... Args>
+    void set_option(CURLoption option, Args... args)
+    {
+        inner_.set_option(option, args...);
+    }
+#else
+    template <typename T1> void set_option(CURLoption option, T1 arg1)
+    {
+        inner_.set_option(option, arg1);
+    }
+
+    template <typename T1, typename T2>
+    void set_option(CURLoption option, T1 arg1, T2 arg2)
+    {
+        inner_.set_option(option, arg1, arg2);
+    }
+#endif
+
+    internal::http_response send(const std::string& request)
+    {
+        auto response = inner_.send(request);
+        record(request, response.code(), response.content());
+        return response;
+    }
+
+    // The body is drained first so that it can be recorded
+    internal::http_response send(internal::upload_source& body)
+    {
+        return send(drain(body));
+    }
+
+    internal::http_response send(const std::string& request,
+                                 internal::response_consumer& consumer)
+    {
+        recording_consumer recorder(consumer);
+        auto response = inner_.send(request, recorder);
+        record(request, response.code(), recorder.raw);
+        return response;
+    }
+
+    void send_async(const std::string& request, async_engine& engine,
+                    internal::completion_handler handler)
+    {
+        auto log = log_;
+        inner_.send_async(
+            request, engine,
+            [log, request, handler](std::exception_ptr error,
+                                    internal::http_response* response) {
+                if (response)
+                {
+                    record(*log, request, response->code(),
+                           response->content());
+                }
+                handler(error, response);
+            });
+    }
+
+private:
+    // Keeps the raw response while handing it on
+    class recording_consumer final : public internal::response_consumer
+    {
+    public:
+        explicit recording_consumer(internal::response_consumer& next)
+            : raw(), next_(next)
+        {
+        }
+
+        bool feed(const char* data, std::size_t len,
+                  std::vector<char>& out) override
+        {
+            raw.insert(raw.end(), data, data + len);
+            return next_.feed(data, len, out);
+        }
+
+        std::vector<char> raw;
+
+    private:
+        internal::response_consumer& next_;
+    };
+
+    InnerHandler inner_;
+    std::shared_ptr<replay_log> log_;
+
+    void record(const std::string& request, long code,
+                const std::vector<char>& content)
+    {
+        record(*log_, request, code, content);
+    }
+
+    static void record(replay_log& log, const std::string& request, long code,
+                       const std::vector<char>& content)
+    {
+        auto end = content.end();
+        if (!content.empty() && content.back() == '\0')
+        {
+            --end;
+        }
+        log.add(recorded_exchange(request, code,
+                                  std::vector<char>(content.begin(), end)));
+    }
+
+    static std::string drain(internal::upload_source& body)
+    {
+        std::string request;
+        std::vector<char> buf(16384);
+        for (auto len = body.read(buf.data(), buf.size()); len != 0U;
+             len = body.read(buf.data(), buf.size()))
+        {
+            request.append(buf.data(), len);
+        }
+        return request;
+    }
+};
+
+typedef basic_recording_request_handler<> recording_request_handler;
+
+//! \brief A RequestHandler that answers requests from the replay_log
+//! installed for its URL, without any network traffic
+//!
+//! Use as the RequestHandler of basic_service, e.g., to measure how the
+//! client scales under recorded production traffic. Responses are delayed
+//! as configured with replay_log::set_options. Asynchronous requests are
+//! answered on the calling thread, so use several threads (and services)
+//! for concurrency.
+class replay_request_handler final
+{
+public:
+    typedef internal::http_request::method method;
+
+    explicit replay_request_handler(const std::string& url)
+        : log_(replay_log::lookup(url))
+    {
+    }
+
+    void set_method(method) {}
+
+    void set_content_type(const std::string&) {}
+
+    void set_content_length(std::size_t) {}
+
+    void set_credentials(const internal::credentials&) {}
+
+    void set_transport_options(const transport_options&) {}
+
+    void set_timeout(std::chrono::milliseconds) {}
+
+    void set_cancellation_token(const cancellation_token&) {}
+
+    void reset_cancellation_token() {}
+
+    void set_header(const std::string&, const std::string&) {}
+
+#ifdef EWS_HAS_VARIADIC_TEMPLATES
+    template <typename... Args> void set_option(CURLoption, Args...) {}
+#else
+    template <typename T1> void set_option(CURLoption, T1) {}
+
+    template <typename T1, typename T2> void set_option(CURLoption, T1, T2)
+    {
+    }
+#endif
+
+    internal::http_response send(const std::string& request)
+    {
+        const auto exchange = log_->find(request);
+        log_->simulate_latency();
+        std::vector<char> data;
+        data.reserve(exchange->response.size() + 1U);
+        data.assign(exchange->response.begin(), exchange->response.end());
+        data.push_back('\0');
+        return internal::http_response(exchange->code, std::move(data));
+    }
+
+    internal::http_response send(internal::upload_source& body)
+    {
+        std::string request;
+        std::vector<char> buf(16384);
+        for (auto len = body.read(buf.data(), buf.size()); len != 0U;
+             len = body.read(buf.data(), buf.size()))
+        {
+            request.append(buf.data(), len);
+        }
+        return send(request);
+    }
+
+    // Hands the recorded response to consumer in chunks, as if it arrived
+    // over the network
+    internal::http_response send(const std::string& request,
+                                 internal::response_consumer& consumer)
+    {
+        const auto exchange = log_->find(request);
+        log_->simulate_latency();
+        const auto& raw = exchange->response;
+        std::vector<char> data;
+        const std::size_t chunk_size = 16384U;
+        for (std::size_t pos = 0U; pos < raw.size(); pos += chunk_size)
+        {
+            if (!consumer.feed(&raw[pos],
+                               std::min(chunk_size, raw.size() - pos), data))
+            {
+                break;
+            }
+        }
+        data.push_back('\0');
+        return internal::http_response(exchange->code, std::move(data));
+    }
+
+    void send_async(const std::string& request, async_engine&,
+                    internal::completion_handler handler)
+    {
+        std::unique_ptr<internal::http_response> response;
+        try
+        {
+            response.reset(new internal::http_response(send(request)));
+        }
+        catch (std::exception&)
+        {
+            handler(std::current_exception(), nullptr);
+            return;
+        }
+        handler(std::exception_ptr(), response.get());
+    }
+
+private:
+    std::shared_ptr<replay_log> log_;
+};
+}
+
+// vim:et ts=4 sw=4
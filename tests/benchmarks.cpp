@@ -0,0 +1,367 @@
+//   Copyright 2016 otris software AG
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//   This project is hosted at https://github.com/otris
+
+// Offline micro-benchmarks of the serialization and parsing hot paths.
+// Nothing is sent over the network; responses come from the canned XML in
+// tests/assets or are generated, requests go to http_request_mock.
+//
+// Run with ./benchmarks --assets=/path/to/source/tests/assets plus any of
+// Google Benchmark's flags, e.g., --benchmark_filter=Parse
+
+#include "fixtures.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+std::string assets_dir = EWS_BENCHMARK_ASSETS_DIR;
+
+std::vector<char> read_asset(const std::string& name)
+{
+    const auto path = assets_dir + "/" + name;
+    std::ifstream ifstr(path, std::ifstream::in | std::ios::binary);
+    if (!ifstr.is_open())
+    {
+        throw std::runtime_error("Could not open file for reading: " + path);
+    }
+    return std::vector<char>(std::istreambuf_iterator<char>(ifstr),
+                             std::istreambuf_iterator<char>());
+}
+
+// A 0-terminated response buffer as http_request would return it
+std::vector<char> read_response_asset(const std::string& name)
+{
+    auto buf = read_asset(name);
+    buf.push_back('\0');
+    return buf;
+}
+
+const std::vector<char>& get_item_response()
+{
+    static const auto buf =
+        read_response_asset("get_item_response_message.xml");
+    return buf;
+}
+
+// A <FindItemResponse> with count message ids
+std::vector<char> make_find_item_response(int count)
+{
+    std::string str =
+        "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+        "<s:Body>"
+        "<m:FindItemResponse "
+        "xmlns:m=\"http://schemas.microsoft.com/exchange/services/2006/"
+        "messages\" "
+        "xmlns:t=\"http://schemas.microsoft.com/exchange/services/2006/"
+        "types\">"
+        "<m:ResponseMessages>"
+        "<m:FindItemResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:RootFolder TotalItemsInView=\"" +
+        std::to_string(count) + "\" IncludesLastItemInRange=\"true\">"
+                                "<t:Items>";
+    for (int i = 0; i < count; ++i)
+    {
+        str += "<t:Message><t:ItemId Id=\"AAMkADk0ZjY3ZWZkLWQ3NTgtNDA3ZC04"
+               "YTI2LTAyMzQ4ZTE1YTJkNgBGAAAAAACUJvCN" +
+               std::to_string(i) +
+               "\" ChangeKey=\"CQAAABYAAAB0rbDkfHFHSK8gGp54tZdBAAAUNAT/"
+               "\"/></t:Message>";
+    }
+    str += "</t:Items></m:RootFolder></m:FindItemResponseMessage>"
+           "</m:ResponseMessages></m:FindItemResponse></s:Body></s:Envelope>";
+    return std::vector<char>(str.c_str(), str.c_str() + str.size() + 1);
+}
+
+ews::basic_service<tests::http_request_mock>& service()
+{
+    static ews::basic_service<tests::http_request_mock> srv(
+        "https://example.com/ews/Exchange.asmx", "FAKEDOMAIN", "fakeuser",
+        "fakepassword");
+    return srv;
+}
+
+void set_next_fake_response(const std::vector<char>& buf)
+{
+    tests::http_request_mock::storage::instance().fake_response = buf;
+}
+
+ews::calendar_item parse_calendar_item(const std::vector<char>& buf)
+{
+    auto response = ews::internal::http_response(200, std::vector<char>(buf));
+    const auto msg =
+        ews::internal::get_item_response_message<ews::calendar_item>::parse(
+            std::move(response));
+    return msg.items().front();
+}
+
+// Request building
+
+void BM_MakeSoapEnvelope(benchmark::State& state)
+{
+    // Like the body of a <GetItem/> request for a chunk of 100 items
+    std::string body = "<m:GetItem><m:ItemShape>"
+                       "<t:BaseShape>AllProperties</t:BaseShape>"
+                       "</m:ItemShape><m:ItemIds>";
+    for (int i = 0; i < 100; ++i)
+    {
+        body += ews::item_id("AAMkADk0ZjY3ZWZkLWQ3NTgtNDA3ZC04" +
+                                 std::to_string(i),
+                             "CQAAABYAAAB0rbDkfHFHSK8gGp54tZdBAAAUNAT/")
+                    .to_xml();
+    }
+    body += "</m:ItemIds></m:GetItem>";
+    const auto headers = std::vector<std::string>(
+        1, "<t:RequestServerVersion Version=\"Exchange2013_SP1\"/>");
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            ews::internal::make_soap_envelope(body, headers));
+    }
+}
+BENCHMARK(BM_MakeSoapEnvelope);
+
+void BM_ItemIdsToXml(benchmark::State& state)
+{
+    const auto ids = std::vector<ews::item_id>(
+        static_cast<std::size_t>(state.range(0)),
+        ews::item_id("AAMkADk0ZjY3ZWZkLWQ3NTgtNDA3ZC04YTI2LTAyMzQ4ZTE1YTJk"
+                     "NgBGAAAAAACUJvCNnY7kQ4oIeoFBVvvcBwB0rbDkfHFHSK8gGp54"
+                     "tZdBAAAAAAEM",
+                     "CQAAABYAAAB0rbDkfHFHSK8gGp54tZdBAAAUNAT/"));
+    std::string buffer;
+    for (auto _ : state)
+    {
+        // Like the <ItemIds> of a <GetItem/> request
+        buffer.clear();
+        for (const auto& id : ids)
+        {
+            id.to_xml(buffer);
+        }
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                            state.range(0));
+}
+BENCHMARK(BM_ItemIdsToXml)->Arg(1000);
+
+void BM_RestrictionToXml(benchmark::State& state)
+{
+    const auto restriction =
+        ews::and_(ews::is_equal_to(ews::item_property_path::subject, "Hello"),
+                  ews::contains(ews::item_property_path::body, "world",
+                                ews::containment_mode::substring,
+                                ews::containment_comparison::ignore_case));
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(restriction.to_xml());
+    }
+}
+BENCHMARK(BM_RestrictionToXml);
+
+void BM_CreateItemRoundTrip(benchmark::State& state)
+{
+    static const char response[] =
+        "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+        "<s:Body>"
+        "<m:CreateItemResponse "
+        "xmlns:m=\"http://schemas.microsoft.com/exchange/services/2006/"
+        "messages\" "
+        "xmlns:t=\"http://schemas.microsoft.com/exchange/services/2006/"
+        "types\">"
+        "<m:ResponseMessages>"
+        "<m:CreateItemResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Items><t:Task><t:ItemId Id=\"abc\" ChangeKey=\"def\"/></t:Task>"
+        "</m:Items>"
+        "</m:CreateItemResponseMessage>"
+        "</m:ResponseMessages></m:CreateItemResponse></s:Body></s:Envelope>";
+    set_next_fake_response(
+        std::vector<char>(response, response + sizeof(response)));
+    auto t = ews::task();
+    t.set_subject("Write benchmarks");
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(service().create_item(t));
+    }
+}
+BENCHMARK(BM_CreateItemRoundTrip);
+
+// Parsing
+
+void BM_ParseResponse(benchmark::State& state)
+{
+    const auto& buf = get_item_response();
+    for (auto _ : state)
+    {
+        auto response =
+            ews::internal::http_response(200, std::vector<char>(buf));
+        benchmark::DoNotOptimize(
+            ews::internal::parse_response(std::move(response)));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(buf.size()));
+}
+BENCHMARK(BM_ParseResponse);
+
+void BM_GetCalendarItem(benchmark::State& state)
+{
+    set_next_fake_response(get_item_response());
+    const auto id = ews::item_id("abc", "def");
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(service().get_calendar_item(id));
+    }
+}
+BENCHMARK(BM_GetCalendarItem);
+
+void BM_FindItem(benchmark::State& state)
+{
+    set_next_fake_response(
+        make_find_item_response(static_cast<int>(state.range(0))));
+    const auto folder =
+        ews::distinguished_folder_id(ews::standard_folder::inbox);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(service().find_item(folder));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                            state.range(0));
+}
+BENCHMARK(BM_FindItem)->Arg(10)->Arg(1000);
+
+// xml_subtree and item access
+
+void BM_ItemCopy(benchmark::State& state)
+{
+    const auto item = parse_calendar_item(get_item_response());
+    for (auto _ : state)
+    {
+        auto copy = item;
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(BM_ItemCopy);
+
+void BM_ItemCopyAndModify(benchmark::State& state)
+{
+    const auto item = parse_calendar_item(get_item_response());
+    for (auto _ : state)
+    {
+        auto copy = item;
+        copy.set_subject("Changed");
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(BM_ItemCopyAndModify);
+
+void BM_XmlSubtreeReparse(benchmark::State& state)
+{
+    auto buf = get_item_response();
+    rapidxml::xml_document<char> doc;
+    doc.parse<0>(&buf[0]);
+    const auto elem = ews::internal::get_element_by_qname(
+        doc, "CalendarItem", ews::internal::uri<>::microsoft::types());
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(ews::internal::xml_subtree(*elem));
+    }
+}
+BENCHMARK(BM_XmlSubtreeReparse);
+
+void BM_Getters(benchmark::State& state)
+{
+    const auto item = parse_calendar_item(get_item_response());
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(item.get_subject());
+        benchmark::DoNotOptimize(item.get_start());
+        benchmark::DoNotOptimize(item.get_location());
+        benchmark::DoNotOptimize(item.get_organizer());
+    }
+}
+BENCHMARK(BM_Getters);
+
+// Base64
+
+void BM_Base64Encode(benchmark::State& state)
+{
+    const auto file = read_asset("ballmer_peak.png");
+    const auto buf = std::vector<unsigned char>(begin(file), end(file));
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(ews::internal::base64::encode(buf));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(buf.size()));
+}
+BENCHMARK(BM_Base64Encode);
+
+void BM_Base64Decode(benchmark::State& state)
+{
+    const auto file = read_asset("ballmer_peak.png");
+    const auto encoded = ews::internal::base64::encode(
+        reinterpret_cast<const unsigned char*>(file.data()), file.size());
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(ews::internal::base64::decode(encoded));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(encoded.size()));
+}
+BENCHMARK(BM_Base64Decode);
+}
+
+int main(int argc, char** argv)
+{
+    // Take --assets=<dir> out before Google Benchmark sees the arguments
+    static const char prefix[] = "--assets=";
+    int kept = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], prefix, sizeof(prefix) - 1) == 0)
+        {
+            assets_dir = argv[i] + sizeof(prefix) - 1;
+        }
+        else
+        {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+
+    ews::set_up();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    std::cout << "Loading assets from: '" << assets_dir << "'\n";
+    benchmark::RunSpecifiedBenchmarks();
+    ews::tear_down();
+    return 0;
+}
+
+// vim:et ts=4 sw=4
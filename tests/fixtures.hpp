@@ -18,6 +18,9 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <exception>
+#include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -87,6 +90,12 @@ struct http_request_mock final
 {
     struct storage
     {
+        storage()
+            : async_requests(0U), unanswered_async_requests(0U),
+              has_cancellation_token(false)
+        {
+        }
+
         static storage& instance()
         {
 #ifdef EWS_HAS_THREAD_LOCAL_STORAGE
@@ -100,6 +109,22 @@ struct http_request_mock final
         std::string request_string;
         std::vector<char> fake_response;
         std::string url;
+        ews::transport_options transport;
+
+        // HTTP headers that were set with set_header
+        std::map<std::string, std::string> headers;
+
+        // Number of asynchronous requests that were sent, and of the next
+        // ones that are never answered, as if the server hung
+        std::size_t async_requests;
+        std::size_t unanswered_async_requests;
+
+        // Whether a cancellation token was set on the last request
+        bool has_cancellation_token;
+
+        // Sent before fake_response, one per request, with given HTTP
+        // status code
+        std::vector<std::pair<long, std::vector<char>>> queued_responses;
     };
 
 #ifdef EWS_HAS_DEFAULT_AND_DELETE
@@ -142,6 +167,36 @@ struct http_request_mock final
 
     void set_credentials(const ews::internal::credentials&) {}
 
+    void set_transport_options(const ews::transport_options& options)
+    {
+        storage::instance().transport = options;
+    }
+
+    void set_timeout(std::chrono::milliseconds) {}
+
+    void set_cancellation_token(const ews::cancellation_token&)
+    {
+        storage::instance().has_cancellation_token = true;
+    }
+
+    void reset_cancellation_token()
+    {
+        storage::instance().has_cancellation_token = false;
+    }
+
+    void set_header(const std::string& name, const std::string& value)
+    {
+        auto& headers = storage::instance().headers;
+        if (value.empty())
+        {
+            headers.erase(name);
+        }
+        else
+        {
+            headers[name] = value;
+        }
+    }
+
 #ifdef EWS_HAS_VARIADIC_TEMPLATES
     template <typename... Args> void set_option(CURLoption, Args...) {}
 #else
@@ -157,9 +212,68 @@ struct http_request_mock final
     {
         auto& s = storage::instance();
         s.request_string = request;
+        if (!s.queued_responses.empty())
+        {
+            auto next = std::move(s.queued_responses.front());
+            s.queued_responses.erase(s.queued_responses.begin());
+            return ews::internal::http_response(next.first,
+                                                std::move(next.second));
+        }
         auto response_bytes = s.fake_response;
         return ews::internal::http_response(200, std::move(response_bytes));
     }
+
+    // Drains the body so that the complete request can be inspected
+    ews::internal::http_response send(ews::internal::upload_source& body)
+    {
+        std::string request;
+        std::vector<char> buf(1000);
+        for (auto len = body.read(buf.data(), buf.size()); len != 0U;
+             len = body.read(buf.data(), buf.size()))
+        {
+            request.append(buf.data(), len);
+        }
+        return send(request);
+    }
+
+    // Replays the fake response through given consumer
+    ews::internal::http_response
+    send(const std::string& request,
+         ews::internal::response_consumer& consumer)
+    {
+        auto& s = storage::instance();
+        s.request_string = request;
+        std::vector<char> response_bytes;
+        const auto& fake = s.fake_response;
+        const std::size_t chunk_size = 1000U;
+        for (std::size_t pos = 0U; pos < fake.size(); pos += chunk_size)
+        {
+            if (!consumer.feed(&fake[pos],
+                               std::min(chunk_size, fake.size() - pos),
+                               response_bytes))
+            {
+                break;
+            }
+        }
+        response_bytes.push_back('\0');
+        return ews::internal::http_response(200, std::move(response_bytes));
+    }
+
+    // Completes immediately, on the calling thread, unless the request is
+    // one of the unanswered ones
+    void send_async(const std::string& request, ews::async_engine&,
+                    ews::internal::completion_handler handler)
+    {
+        auto& s = storage::instance();
+        ++s.async_requests;
+        if (s.unanswered_async_requests != 0U)
+        {
+            --s.unanswered_async_requests;
+            return;
+        }
+        auto response = send(request);
+        handler(std::exception_ptr(), &response);
+    }
 };
 
 // Per-test-case set-up and tear-down
@@ -205,10 +319,30 @@ public:
         storage.fake_response = std::move(buffer);
     }
 
+    // Makes the next request that is sent receive given response instead
+    // of the fake response; several of these are sent in order
+    void queue_fake_response(long code, const std::string& str)
+    {
+        auto& storage = http_request_mock::storage::instance();
+        std::vector<char> buffer(str.begin(), str.end());
+        buffer.push_back('\0');
+        storage.queued_responses.emplace_back(code, std::move(buffer));
+    }
+
+    std::size_t queued_fake_responses() const
+    {
+        return http_request_mock::storage::instance().queued_responses.size();
+    }
+
 protected:
     virtual void SetUp()
     {
         BaseFixture::SetUp();
+        auto& storage = http_request_mock::storage::instance();
+        storage.queued_responses.clear();
+        storage.async_requests = 0U;
+        storage.unanswered_async_requests = 0U;
+        storage.has_cancellation_token = false;
 #ifdef EWS_HAS_MAKE_UNIQUE
         service_ptr_ = std::make_unique<ews::basic_service<http_request_mock>>(
             "https://example.com/ews/Exchange.asmx", "FAKEDOMAIN", "fakeuser",
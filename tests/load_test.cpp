@@ -0,0 +1,327 @@
+//   Copyright 2016 otris software AG
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+//
+//   This project is hosted at https://github.com/otris
+
+// Offline load test. Replays recorded traffic (see ews::replay_log) from
+// several threads against a simulated server and reports throughput and
+// latency percentiles of the client.
+//
+// Every thread has its own ews::basic_service and issues, for each
+// recorded exchange, a call of the same operation through it, so request
+// serialization, the handler and response parsing are all measured. The
+// replay log answers a call with the recorded responses of its operation in
+// turn. Exchanges of operations without such a call are left out; see
+// dispatch below.
+//
+// Run with ./load_test --recording=traffic.ewsreplay [--threads=N]
+// [--iterations=N] [--latency-ms=N] [--jitter-ms=N] [--concurrency=N].
+// Without --recording, a GetItem response from tests/assets is replayed;
+// pass --assets=/path/to/source/tests/assets if it is not found.
+
+#include <ews/ews.hpp>
+#include <ews/ews_replay.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const std::string url = "https://replay.invalid/EWS/Exchange.asmx";
+
+typedef ews::basic_service<ews::replay_request_handler> replay_service;
+
+struct load_options
+{
+    std::string recording;
+    std::string assets_dir = EWS_LOAD_TEST_ASSETS_DIR;
+    int threads = 4;
+    int iterations = 1000;
+    int latency_ms = 0;
+    int jitter_ms = 0;
+    int concurrency = 0;
+};
+
+bool parse_option(const char* arg, const char* name, std::string& value)
+{
+    const auto len = std::strlen(name);
+    if (std::strncmp(arg, name, len) != 0 || arg[len] != '=')
+    {
+        return false;
+    }
+    value = arg + len + 1;
+    return true;
+}
+
+load_options parse_options(int argc, char** argv)
+{
+    load_options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string value;
+        if (parse_option(argv[i], "--recording", value))
+        {
+            opts.recording = value;
+        }
+        else if (parse_option(argv[i], "--assets", value))
+        {
+            opts.assets_dir = value;
+        }
+        else if (parse_option(argv[i], "--threads", value))
+        {
+            opts.threads = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (parse_option(argv[i], "--iterations", value))
+        {
+            opts.iterations = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (parse_option(argv[i], "--latency-ms", value))
+        {
+            opts.latency_ms = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (parse_option(argv[i], "--jitter-ms", value))
+        {
+            opts.jitter_ms = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (parse_option(argv[i], "--concurrency", value))
+        {
+            opts.concurrency = std::max(0, std::atoi(value.c_str()));
+        }
+        else
+        {
+            throw std::runtime_error(std::string("Unknown option: ") +
+                                     argv[i]);
+        }
+    }
+    return opts;
+}
+
+void load_recording(const load_options& opts, ews::replay_log& log)
+{
+    if (!opts.recording.empty())
+    {
+        std::ifstream ifstr(opts.recording, std::ios::binary);
+        if (!ifstr.is_open())
+        {
+            throw std::runtime_error("Could not open file for reading: " +
+                                     opts.recording);
+        }
+        log.load(ifstr);
+        return;
+    }
+
+    const auto path = opts.assets_dir + "/get_item_response_message.xml";
+    std::ifstream ifstr(path, std::ios::binary);
+    if (!ifstr.is_open())
+    {
+        throw std::runtime_error("Could not open file for reading: " + path);
+    }
+    std::vector<char> response((std::istreambuf_iterator<char>(ifstr)),
+                               std::istreambuf_iterator<char>());
+    const auto request = ews::internal::make_soap_envelope(
+        "<m:GetItem><m:ItemShape><t:BaseShape>AllProperties</t:BaseShape>"
+        "</m:ItemShape><m:ItemIds><t:ItemId Id=\"abc\" ChangeKey=\"def\"/>"
+        "</m:ItemIds></m:GetItem>",
+        std::vector<std::string>());
+    log.add(ews::recorded_exchange(request, 200L, std::move(response)));
+}
+
+// Operations dispatch can issue
+const char* const replayable_operations[] = {
+    "GetItem", "FindItem", "GetFolder", "FindFolder", "GetAttachment"};
+
+bool is_replayable(const std::string& operation)
+{
+    return std::find(std::begin(replayable_operations),
+                     std::end(replayable_operations),
+                     operation) != std::end(replayable_operations);
+}
+
+// Issues a call of given operation through the service
+void dispatch(replay_service& service, const std::string& operation)
+{
+    const auto inbox =
+        ews::distinguished_folder_id(ews::standard_folder::inbox);
+    if (operation == "GetItem")
+    {
+        service.get_message(ews::item_id("abc", "def"));
+    }
+    else if (operation == "FindItem")
+    {
+        service.find_item(inbox);
+    }
+    else if (operation == "GetFolder")
+    {
+        service.get_folder(inbox);
+    }
+    else if (operation == "FindFolder")
+    {
+        service.find_folder(ews::indexed_page_item_view(1000U, 0U), inbox);
+    }
+    else if (operation == "GetAttachment")
+    {
+        service.get_attachment(ews::attachment_id("abc"));
+    }
+    else
+    {
+        throw std::runtime_error("Cannot replay <" + operation + "/>");
+    }
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+    const auto index = static_cast<std::size_t>(
+        p * static_cast<double>(sorted.size() - 1U) + 0.5);
+    return sorted[index];
+}
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        const auto opts = parse_options(argc, argv);
+
+        ews::set_up();
+        auto log = std::make_shared<ews::replay_log>();
+        load_recording(opts, *log);
+        if (log->size() == 0U)
+        {
+            throw std::runtime_error("Recording is empty");
+        }
+        ews::replay_options replay;
+        replay.latency = std::chrono::milliseconds(opts.latency_ms);
+        replay.jitter = std::chrono::milliseconds(opts.jitter_ms);
+        replay.max_concurrent_requests =
+            static_cast<std::size_t>(opts.concurrency);
+        log->set_options(replay);
+        ews::replay_log::install(url, log);
+
+        std::vector<std::string> operations;
+        for (std::size_t i = 0U; i < log->size(); ++i)
+        {
+            auto operation = ews::replay_log::operation_of(log->at(i)->request);
+            if (is_replayable(operation))
+            {
+                operations.emplace_back(std::move(operation));
+            }
+        }
+        if (operations.empty())
+        {
+            throw std::runtime_error("Recording has no replayable exchanges");
+        }
+
+        // Each thread cycles through the recorded operations, starting at a
+        // different one. Error responses are part of the recorded traffic
+        // and counted separately from failures of the client.
+        std::vector<std::vector<double>> latencies(
+            static_cast<std::size_t>(opts.threads));
+        std::vector<int> errors(static_cast<std::size_t>(opts.threads), 0);
+        std::vector<int> error_responses(
+            static_cast<std::size_t>(opts.threads), 0);
+        std::vector<std::thread> workers;
+        const auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < opts.threads; ++t)
+        {
+            workers.emplace_back([&, t] {
+                auto& samples = latencies[static_cast<std::size_t>(t)];
+                samples.reserve(static_cast<std::size_t>(opts.iterations));
+                replay_service service(url, "", "", "");
+                for (int i = 0; i < opts.iterations; ++i)
+                {
+                    const auto& operation =
+                        operations[static_cast<std::size_t>(t + i) %
+                                   operations.size()];
+                    const auto before = std::chrono::steady_clock::now();
+                    try
+                    {
+                        dispatch(service, operation);
+                    }
+                    catch (ews::exchange_error&)
+                    {
+                        ++error_responses[static_cast<std::size_t>(t)];
+                    }
+                    catch (std::exception&)
+                    {
+                        ++errors[static_cast<std::size_t>(t)];
+                    }
+                    const auto after = std::chrono::steady_clock::now();
+                    samples.push_back(
+                        std::chrono::duration<double, std::milli>(after -
+                                                                  before)
+                            .count());
+                }
+            });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        const auto elapsed = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+        ews::replay_log::uninstall(url);
+        ews::tear_down();
+
+        std::vector<double> all;
+        int error_count = 0;
+        int error_response_count = 0;
+        for (std::size_t t = 0U; t < latencies.size(); ++t)
+        {
+            all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+            error_count += errors[t];
+            error_response_count += error_responses[t];
+        }
+        std::sort(all.begin(), all.end());
+
+        std::cout << "Recorded exchanges: " << log->size() << '\n'
+                  << "Replayed exchanges: " << operations.size() << '\n'
+                  << "Threads:            " << opts.threads << '\n'
+                  << "Requests:           " << all.size() << '\n'
+                  << "Error responses:    " << error_response_count << '\n'
+                  << "Errors:             " << error_count << '\n'
+                  << "Elapsed:            " << elapsed << " s\n"
+                  << "Throughput:         "
+                  << static_cast<double>(all.size()) / elapsed << " req/s\n"
+                  << "Latency p50:        " << percentile(all, 0.50)
+                  << " ms\n"
+                  << "Latency p90:        " << percentile(all, 0.90)
+                  << " ms\n"
+                  << "Latency p99:        " << percentile(all, 0.99)
+                  << " ms\n"
+                  << "Latency max:        " << all.back() << " ms\n";
+        return error_count == 0 ? 0 : 1;
+    }
+    catch (std::exception& exc)
+    {
+        std::cerr << exc.what() << std::endl;
+        return 1;
+    }
+}
+
+// vim:et ts=4 sw=4
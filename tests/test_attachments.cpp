@@ -20,6 +20,7 @@
 #include <cstring>
 #include <ews/rapidxml/rapidxml_print.hpp>
 #include <iterator>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -313,6 +314,19 @@ TEST_F(FileAttachmentTest, CreateFromFile)
     EXPECT_EQ(93525U, file_attachment.content_size());
 }
 
+TEST_F(FileAttachmentTest, WriteContentRestoresFileContents)
+{
+    const auto path = assets_dir() / "ballmer_peak.png";
+    auto file_attachment =
+        ews::attachment::from_file(path.string(), "image/png", "Ballmer Peak");
+    std::ostringstream os;
+    EXPECT_EQ(93525U, file_attachment.write_content(os));
+    const auto expected = read_file(path);
+    const auto actual = os.str();
+    ASSERT_EQ(expected.size(), actual.size());
+    EXPECT_TRUE(std::equal(begin(expected), end(expected), begin(actual)));
+}
+
 TEST_F(FileAttachmentTest, CreateFromFileThrowsIfFileDoesNotExists)
 {
     const auto path = assets_dir() / "unlikely_to_exist.txt";
@@ -189,6 +189,160 @@ TEST_F(AutodiscoverTest, GetExchangeWebServicesURLExceptionText)
                      exc.what());
     }
 }
+
+class AutodiscoverResolverTest : public AutodiscoverTest
+{
+public:
+    AutodiscoverResolverTest() : engine_() {}
+
+    ews::async_engine& engine() { return engine_; }
+
+    void set_found()
+    {
+        set_next_fake_response(
+            read_file(assets_dir() / "autodiscover_response.xml"));
+    }
+
+    void set_not_found()
+    {
+        set_next_fake_response(
+            read_file(assets_dir() / "autodiscover_response_error.xml"));
+    }
+
+    // The next request receives given HTTP status instead of the fake
+    // response
+    void queue_status(long code)
+    {
+        std::vector<char> body(1U, '\0');
+        http_request_mock::storage::instance().queued_responses.emplace_back(
+            code, std::move(body));
+    }
+
+private:
+    ews::async_engine engine_;
+};
+
+TEST_F(AutodiscoverResolverTest, ResolveReturnsEwsUrls)
+{
+    set_found();
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(engine());
+    const auto result = resolver.resolve(address(), credentials());
+    EXPECT_EQ("https://outlook.office365.com/EWS/Exchange.asmx",
+              result.internal_ews_url);
+    EXPECT_EQ("https://outlook.another.office365.com/EWS/Exchange.asmx",
+              result.external_ews_url);
+}
+
+TEST_F(AutodiscoverResolverTest, InvalidAddressThrows)
+{
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(engine());
+    EXPECT_THROW(resolver.resolve("", credentials()), ews::exception);
+    EXPECT_THROW(resolver.resolve("typo", credentials()), ews::exception);
+    EXPECT_EQ(0U, resolver.cached_addresses());
+}
+
+TEST_F(AutodiscoverResolverTest, CachesResultPerAddress)
+{
+    set_found();
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(engine());
+    resolver.resolve(address(), credentials());
+
+    set_not_found();
+    const auto result =
+        resolver.resolve("DDuck@Duckburg.onmicrosoft.com", credentials());
+    EXPECT_EQ("https://outlook.office365.com/EWS/Exchange.asmx",
+              result.internal_ews_url);
+    EXPECT_EQ(1U, resolver.cached_addresses());
+    EXPECT_EQ(1U, resolver.cached_domains());
+}
+
+TEST_F(AutodiscoverResolverTest, SharesResultWithinDomain)
+{
+    set_found();
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(engine());
+    resolver.resolve(address(), credentials());
+
+    set_not_found();
+    const auto result =
+        resolver.resolve("gus@duckburg.onmicrosoft.com", credentials());
+    EXPECT_EQ("https://outlook.office365.com/EWS/Exchange.asmx",
+              result.internal_ews_url);
+    EXPECT_EQ(2U, resolver.cached_addresses());
+}
+
+TEST_F(AutodiscoverResolverTest, ProbesAllCandidatesAndRemembersEndpoint)
+{
+    set_found();
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(engine());
+    resolver.set_share_domain_results(false);
+
+    // First candidate fails, second one answers
+    queue_status(404);
+    resolver.resolve(address(), credentials());
+    auto& storage = http_request_mock::storage::instance();
+    EXPECT_TRUE(storage.queued_responses.empty());
+
+    // Next address of the domain goes straight to the endpoint that
+    // answered
+    storage.url.clear();
+    resolver.resolve("gus@duckburg.onmicrosoft.com", credentials());
+    EXPECT_EQ("https://autodiscover.duckburg.onmicrosoft.com/autodiscover/"
+              "autodiscover.xml",
+              storage.url);
+    EXPECT_NE(std::string::npos,
+              storage.request_string.find("gus@duckburg.onmicrosoft.com"));
+}
+
+TEST_F(AutodiscoverResolverTest, FailsIfNoCandidateAnswers)
+{
+    set_found();
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(engine());
+    queue_status(404);
+    queue_status(503);
+    EXPECT_THROW(resolver.resolve(address(), credentials()), ews::http_error);
+    EXPECT_EQ(0U, resolver.cached_addresses());
+    EXPECT_EQ(0U, resolver.cached_domains());
+}
+
+TEST_F(AutodiscoverResolverTest, DoesNotCacheErrors)
+{
+    set_not_found();
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(engine());
+    EXPECT_THROW(resolver.resolve(address(), credentials()), ews::exception);
+    EXPECT_EQ(0U, resolver.cached_addresses());
+
+    // The endpoint is kept, though
+    EXPECT_EQ(1U, resolver.cached_domains());
+
+    set_found();
+    const auto result = resolver.resolve(address(), credentials());
+    EXPECT_EQ("https://outlook.office365.com/EWS/Exchange.asmx",
+              result.internal_ews_url);
+}
+
+TEST_F(AutodiscoverResolverTest, ExpiredEntriesAreResolvedAgain)
+{
+    set_found();
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(
+        engine(), std::chrono::seconds(0));
+    resolver.resolve(address(), credentials());
+
+    set_not_found();
+    EXPECT_THROW(resolver.resolve(address(), credentials()), ews::exception);
+}
+
+TEST_F(AutodiscoverResolverTest, ClearRemovesAllEntries)
+{
+    set_found();
+    ews::basic_autodiscover_resolver<http_request_mock> resolver(engine());
+    resolver.resolve(address(), credentials());
+    resolver.clear();
+    EXPECT_EQ(0U, resolver.cached_addresses());
+    EXPECT_EQ(0U, resolver.cached_domains());
+
+    set_not_found();
+    EXPECT_THROW(resolver.resolve(address(), credentials()), ews::exception);
+}
 }
 
 #endif // EWS_USE_BOOST_LIBRARY
@@ -73,6 +73,18 @@ TEST(FolderTest, DistinguishedFolderIdToXML)
     EXPECT_STREQ(expected, folder.to_xml().c_str());
 }
 
+TEST(FolderTest, ToXMLAppendsToString)
+{
+    std::string str = "<m:FolderIds>";
+    ews::folder_id("abcde").to_xml(str);
+    const ews::folder_id& folder =
+        ews::distinguished_folder_id(ews::standard_folder::inbox, "ck");
+    folder.to_xml(str);
+    EXPECT_STREQ("<m:FolderIds><t:FolderId Id=\"abcde\"/>"
+                 "<t:DistinguishedFolderId Id=\"inbox\" ChangeKey=\"ck\"/>",
+                 str.c_str());
+}
+
 TEST(FolderTest, DistinguishedFolderIdToXMLWithChangeKey)
 {
     const char* expected =
@@ -413,6 +413,166 @@ TEST(InternalTest, SubTreeCopyAndAssignment)
     EXPECT_STREQ("<a><b/></a>", a.to_string().c_str());
 }
 
+TEST(InternalTest, SubTreeCopiesShareTreeUntilModified)
+{
+    using namespace ews::internal;
+
+    rapidxml::xml_document<> doc;
+    auto str = doc.allocate_string(contact_card.c_str());
+    doc.parse<0>(str);
+    auto contact_element =
+        get_element_by_qname(doc, "Contact", uri<>::microsoft::types());
+    auto original = xml_subtree(*contact_element);
+    EXPECT_FALSE(original.is_shared());
+
+    const auto copy = original;
+    EXPECT_TRUE(original.is_shared());
+    EXPECT_TRUE(copy.is_shared());
+    const auto& const_original = original;
+    EXPECT_EQ(const_original.root(), copy.root());
+
+    original.set_or_update("Culture", "de-DE");
+    EXPECT_FALSE(original.is_shared());
+    EXPECT_FALSE(copy.is_shared());
+    EXPECT_STREQ("de-DE", original.get_value_as_string("Culture").c_str());
+    EXPECT_STREQ("en-US", copy.get_value_as_string("Culture").c_str());
+
+    // Setting the same value again does not copy the tree
+    auto another_copy = original;
+    another_copy.set_or_update("Culture", "de-DE");
+    EXPECT_TRUE(another_copy.is_shared());
+}
+
+TEST(InternalTest, SubTreeNodeNameFromBuffer)
+{
+    using namespace ews::internal;
+
+    rapidxml::xml_document<> doc;
+    auto str = doc.allocate_string(contact_card.c_str());
+    doc.parse<0>(str);
+    auto contact_element =
+        get_element_by_qname(doc, "Contact", uri<>::microsoft::types());
+    const auto subtree = xml_subtree(*contact_element);
+
+    // Only the characters up to the terminator count
+    char name[32] = "Culture";
+    ASSERT_NE(nullptr, subtree.get_node(name));
+    EXPECT_STREQ("en-US", subtree.get_value_as_string(name).c_str());
+}
+
+TEST(InternalTest, MovedFromSubTreeIsEmpty)
+{
+    using namespace ews::internal;
+
+    rapidxml::xml_document<> doc;
+    auto str = doc.allocate_string(contact_card.c_str());
+    doc.parse<0>(str);
+    auto contact_element =
+        get_element_by_qname(doc, "Contact", uri<>::microsoft::types());
+    auto original = xml_subtree(*contact_element);
+    auto moved = std::move(original);
+    EXPECT_STREQ("en-US", moved.get_value_as_string("Culture").c_str());
+
+    const auto& const_original = original;
+    EXPECT_EQ(nullptr, const_original.root());
+    EXPECT_EQ(nullptr, const_original.get_node("Culture"));
+    EXPECT_TRUE(const_original.get_value_as_string("Culture").empty());
+    EXPECT_TRUE(const_original.to_string().empty());
+    EXPECT_FALSE(original.is_shared());
+
+    auto assigned = xml_subtree();
+    assigned = std::move(moved);
+    const auto& const_moved = moved;
+    EXPECT_EQ(nullptr, const_moved.root());
+
+    // A moved-from sub-tree can be used again
+    original.set_or_update("Culture", "de-DE");
+    EXPECT_STREQ("de-DE", original.get_value_as_string("Culture").c_str());
+    EXPECT_STREQ("en-US", assigned.get_value_as_string("Culture").c_str());
+
+    auto item = ews::message();
+    item.set_subject("Hello");
+    const auto other = std::move(item);
+    EXPECT_EQ("Hello", other.get_subject());
+    EXPECT_TRUE(item.get_subject().empty());
+    EXPECT_FALSE(item.get_item_id().valid());
+}
+
+TEST(InternalTest, SubTreeViewIntoSharedResponse)
+{
+    using namespace ews::internal;
+
+    auto subtree = xml_subtree();
+    {
+        std::vector<char> data(begin(contact_card), end(contact_card));
+        data.push_back('\0');
+        const auto doc = parse_response_shared(
+            http_response(200, std::move(data)));
+        auto contact_element =
+            get_element_by_qname(*doc, "Contact", uri<>::microsoft::types());
+        ASSERT_TRUE(contact_element);
+        subtree = xml_subtree(doc, *contact_element);
+        const auto& const_subtree = subtree;
+        EXPECT_EQ(contact_element, const_subtree.root());
+    }
+
+    // The view keeps the response document alive
+    EXPECT_TRUE(subtree.is_shared());
+    EXPECT_STREQ("en-US", subtree.get_value_as_string("Culture").c_str());
+
+    auto copy = subtree;
+    copy.set_or_update("Culture", "de-DE");
+    EXPECT_FALSE(copy.is_shared());
+    EXPECT_STREQ("de-DE", copy.get_value_as_string("Culture").c_str());
+    EXPECT_STREQ("true", copy.get_value_as_string("Modify").c_str());
+    EXPECT_STREQ("en-US", subtree.get_value_as_string("Culture").c_str());
+}
+
+TEST(InternalTest, SubTreeLookupMatchesTreeSearch)
+{
+    using namespace ews::internal;
+
+    rapidxml::xml_document<> doc;
+    const auto xml = std::string(
+        "<t:Item xmlns:t=\"http://schemas.microsoft.com/exchange/services/"
+        "2006/types\">"
+        "<t:Outer><t:Name>inner</t:Name></t:Outer>"
+        "<t:Name>outer</t:Name>"
+        "<t:Size>42</t:Size>"
+        "</t:Item>");
+    auto str = doc.allocate_string(xml.c_str());
+    doc.parse<0>(str);
+    const auto subtree = xml_subtree(*doc.first_node());
+
+    const char* const names[] = {"Item", "Outer", "Name", "Size", "Missing"};
+    for (const auto name : names)
+    {
+        EXPECT_EQ(get_element_by_qname(*subtree.document(), name,
+                                       uri<>::microsoft::types()),
+                  subtree.get_node(name))
+            << name;
+    }
+    EXPECT_STREQ("inner", subtree.get_value_as_string("Name").c_str());
+}
+
+TEST(InternalTest, SubTreeLookupSeesModifications)
+{
+    using namespace ews::internal;
+
+    rapidxml::xml_document<> doc;
+    auto str = doc.allocate_string(contact_card.c_str());
+    doc.parse<0>(str);
+    auto contact_element =
+        get_element_by_qname(doc, "Contact", uri<>::microsoft::types());
+    auto subtree = xml_subtree(*contact_element);
+    const auto& const_subtree = subtree;
+    EXPECT_EQ(nullptr, const_subtree.get_node("Department"));
+
+    create_node(*subtree.document()->first_node(), "t:Department", "R&D");
+    EXPECT_STREQ("R&D",
+                 const_subtree.get_value_as_string("Department").c_str());
+}
+
 // TODO: test size_hint parameter of xml_subtree reduces/eliminates reallocs
 
 TEST(InternalTest, XMLParseErrorMessageShort)
@@ -475,6 +635,594 @@ TEST(InternalTest, HTTPErrorContainsStatusCodeString)
     EXPECT_EQ(404, error.code());
     EXPECT_STREQ("HTTP status code: 404 (Not Found)", error.what());
 }
+
+TEST(InternalTest, ContentLengthFromHeader)
+{
+    using ews::internal::content_length_from_header;
+
+    const std::string header = "Content-Length: 1234\r\n";
+    EXPECT_EQ(1234U, content_length_from_header(header.data(), header.size()));
+
+    const std::string lower_case = "content-length:42\r\n";
+    EXPECT_EQ(42U,
+              content_length_from_header(lower_case.data(), lower_case.size()));
+
+    const std::string other = "Content-Type: text/xml\r\n";
+    EXPECT_EQ(0U, content_length_from_header(other.data(), other.size()));
+
+    // Not null-terminated; the length must be respected
+    const char truncated[] = {'C', 'o', 'n', 't', 'e', 'n', 't', '-',
+                              'L', 'e', 'n', 'g', 't', 'h', ':', '7', '8'};
+    EXPECT_EQ(7U, content_length_from_header(truncated, 16U));
+}
+
+TEST(InternalTest, OperationName)
+{
+    using ews::internal::operation_name;
+
+    EXPECT_EQ("GetItem", operation_name("<m:GetItem><m:ItemShape/>"));
+    EXPECT_EQ("FindItem", operation_name("<m:FindItem Traversal=\"Shallow\">"));
+    EXPECT_EQ("Unsubscribe", operation_name("<Unsubscribe/>"));
+    EXPECT_EQ("", operation_name(""));
+}
+
+TEST(InternalTest, ObservedResponseReportsWhenDestroyed)
+{
+    struct recorder : public ews::request_observer
+    {
+        void on_request_completed(const ews::request_metrics& m) override
+        {
+            metrics.push_back(m);
+        }
+
+        std::vector<ews::request_metrics> metrics;
+    };
+
+    const std::string xml =
+        "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+        "<s:Header/><s:Body>"
+        "<m:DeleteItemResponse xmlns:m=\"http://schemas.microsoft.com/"
+        "exchange/services/2006/messages\">"
+        "<m:ResponseMessages>"
+        "<m:DeleteItemResponseMessage ResponseClass=\"Success\"/>"
+        "<m:DeleteItemResponseMessage ResponseClass=\"Success\"/>"
+        "</m:ResponseMessages>"
+        "</m:DeleteItemResponse></s:Body></s:Envelope>";
+
+    recorder rec;
+    {
+        auto response = ews::internal::http_response(
+            200, std::vector<char>(xml.c_str(), xml.c_str() + xml.size() + 1));
+        response.observe(rec, "DeleteItem", 42U);
+
+        // Moved-from responses do not report
+        auto moved = std::move(response);
+        ews::internal::parse_response(std::move(moved));
+        EXPECT_TRUE(rec.metrics.empty());
+    }
+    ASSERT_EQ(1U, rec.metrics.size());
+    const auto& m = rec.metrics.front();
+    EXPECT_EQ("DeleteItem", m.operation);
+    EXPECT_EQ(42U, m.request_bytes);
+    EXPECT_EQ(xml.size(), m.response_bytes);
+    EXPECT_EQ(200L, m.http_status);
+    EXPECT_EQ(2U, m.result_count);
+}
+
+TEST(InternalTest, IdempotentOperations)
+{
+    using ews::internal::is_idempotent_operation;
+
+    EXPECT_TRUE(is_idempotent_operation("GetItem"));
+    EXPECT_TRUE(is_idempotent_operation("FindFolder"));
+    EXPECT_TRUE(is_idempotent_operation("SyncFolderItems"));
+    EXPECT_TRUE(is_idempotent_operation("ResolveNames"));
+    EXPECT_FALSE(is_idempotent_operation("CreateItem"));
+    EXPECT_FALSE(is_idempotent_operation("SendItem"));
+    EXPECT_FALSE(is_idempotent_operation("DeleteItem"));
+}
+
+TEST(InternalTest, RetryBackoffGrowsExponentiallyWithJitter)
+{
+    using ews::internal::retry_backoff;
+    using std::chrono::milliseconds;
+
+    ews::retry_policy policy;
+    policy.initial_backoff = milliseconds(100);
+    policy.max_backoff = milliseconds(1000);
+    const auto none = milliseconds(0);
+
+    EXPECT_EQ(milliseconds(50), retry_backoff(policy, 1U, none, 0.0));
+    EXPECT_EQ(milliseconds(99), retry_backoff(policy, 1U, none, 0.999));
+    EXPECT_EQ(milliseconds(100), retry_backoff(policy, 2U, none, 0.0));
+    EXPECT_EQ(milliseconds(200), retry_backoff(policy, 3U, none, 0.0));
+    EXPECT_EQ(milliseconds(500), retry_backoff(policy, 5U, none, 0.0));
+    EXPECT_EQ(milliseconds(500), retry_backoff(policy, 50U, none, 0.0));
+
+    // The server's hint wins, even beyond max_backoff
+    EXPECT_EQ(milliseconds(5000),
+              retry_backoff(policy, 1U, milliseconds(5000), 0.5));
+}
+
+TEST(InternalTest, Base64EncodeTestVectors)
+{
+    using ews::internal::base64::encode;
+
+    const auto enc = [](const char* str) {
+        return encode(reinterpret_cast<const unsigned char*>(str),
+                      std::strlen(str));
+    };
+    EXPECT_STREQ("", enc("").c_str());
+    EXPECT_STREQ("Zg==", enc("f").c_str());
+    EXPECT_STREQ("Zm8=", enc("fo").c_str());
+    EXPECT_STREQ("Zm9v", enc("foo").c_str());
+    EXPECT_STREQ("Zm9vYg==", enc("foob").c_str());
+    EXPECT_STREQ("Zm9vYmE=", enc("fooba").c_str());
+    EXPECT_STREQ("Zm9vYmFy", enc("foobar").c_str());
+}
+
+TEST(InternalTest, Base64DecodeStopsAtPaddingOrInvalidChar)
+{
+    using ews::internal::base64::decode;
+
+    const auto dec = [](const std::string& str) {
+        const auto bytes = decode(str);
+        return std::string(begin(bytes), end(bytes));
+    };
+    EXPECT_EQ("", dec(""));
+    EXPECT_EQ("f", dec("Zg=="));
+    EXPECT_EQ("fo", dec("Zm8="));
+    EXPECT_EQ("foobar", dec("Zm9vYmFy"));
+    EXPECT_EQ("fooba", dec("Zm9vYmE=Zm9v"));
+    EXPECT_EQ("foo", dec("Zm9v\nYmFy"));
+}
+
+TEST(InternalTest, Base64StreamingMatchesOneShot)
+{
+    using namespace ews::internal::base64;
+
+    std::vector<unsigned char> data(1000);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<unsigned char>(i * 7U);
+    }
+    const auto expected = encode(data);
+    EXPECT_EQ(encoded_size(data.size()), expected.size());
+
+    for (std::size_t chunk = 1U; chunk < 9U; ++chunk)
+    {
+        encoder enc;
+        std::string encoded;
+        std::vector<char> out(encoded_size(chunk + 2U));
+        for (std::size_t pos = 0U; pos < data.size(); pos += chunk)
+        {
+            const auto len = std::min(chunk, data.size() - pos);
+            const auto count = enc.update(&data[pos], len, out.data());
+            encoded.append(out.data(), count);
+        }
+        encoded.append(out.data(), enc.finish(out.data()));
+        EXPECT_EQ(expected, encoded);
+
+        decoder dec;
+        std::vector<unsigned char> decoded;
+        std::vector<unsigned char> buf(decoded_size_max(chunk + 3U));
+        for (std::size_t pos = 0U; pos < encoded.size(); pos += chunk)
+        {
+            const auto len = std::min(chunk, encoded.size() - pos);
+            const auto count = dec.update(&encoded[pos], len, buf.data());
+            decoded.insert(end(decoded), buf.begin(), buf.begin() + count);
+        }
+        const auto count = dec.finish(buf.data());
+        decoded.insert(end(decoded), buf.begin(), buf.begin() + count);
+        EXPECT_EQ(data, decoded);
+    }
+}
+
+TEST(InternalTest, Base64UploadSourceProducesWholeBody)
+{
+    std::string data(200001U, '\0');
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(i * 13U);
+    }
+    const auto expected =
+        "<head>" +
+        ews::internal::base64::encode(
+            reinterpret_cast<const unsigned char*>(data.data()), data.size()) +
+        "</tail>";
+
+    std::istringstream content(data);
+    ews::internal::base64_upload_source source("<head>", content, "</tail>");
+    ASSERT_TRUE(source.size_known());
+    EXPECT_EQ(expected.size(), source.size());
+
+    const auto drain = [&] {
+        std::string body;
+        char buf[777];
+        for (auto len = source.read(buf, sizeof(buf)); len != 0U;
+             len = source.read(buf, sizeof(buf)))
+        {
+            body.append(buf, len);
+        }
+        return body;
+    };
+    EXPECT_EQ(expected, drain());
+
+    // Sent again, e.g., after an authentication round-trip
+    ASSERT_TRUE(source.rewind());
+    EXPECT_EQ(expected, drain());
+}
+
+TEST(InternalTest, ContentExtractorDecodesContentElements)
+{
+    const std::string response = "<m:Attachments><t:FileAttachment>"
+                                 "<t:ContentType>text/plain</t:ContentType>"
+                                 "<t:Content>Zm9vYmFy</t:Content>"
+                                 "<t:ContentId>Zm9v</t:ContentId>"
+                                 "<Content>YmF6</Content>"
+                                 "</t:FileAttachment></m:Attachments>";
+    const std::string expected = "<m:Attachments><t:FileAttachment>"
+                                 "<t:ContentType>text/plain</t:ContentType>"
+                                 "<t:Content></t:Content>"
+                                 "<t:ContentId>Zm9v</t:ContentId>"
+                                 "<Content></Content>"
+                                 "</t:FileAttachment></m:Attachments>";
+
+    for (std::size_t chunk = 1U; chunk <= response.size(); chunk *= 2U)
+    {
+        std::ostringstream sink;
+        ews::internal::content_extractor extractor(sink);
+        std::vector<char> out;
+        for (std::size_t pos = 0U; pos < response.size(); pos += chunk)
+        {
+            extractor.feed(&response[pos],
+                           std::min(chunk, response.size() - pos), out);
+        }
+        EXPECT_EQ(expected, std::string(out.begin(), out.end()));
+        EXPECT_EQ("foobarbaz", sink.str());
+        EXPECT_EQ(9U, extractor.bytes_written());
+    }
+}
+
+TEST(InternalTest, EnvelopeSplitterEmitsEachCompleteEnvelope)
+{
+    const std::string response =
+        "<s:Envelope><s:Body>a</s:Body></s:Envelope>\r\n"
+        "<Envelope>b<!-- not </Envelope -->c</Envelope>"
+        "<soap:Envelope><xEnvelope>d</xEnvelope></soap:Envelope>"
+        "<s:Envelope>incomplete";
+
+    for (std::size_t chunk = 1U; chunk <= response.size(); chunk *= 2U)
+    {
+        std::vector<std::string> envelopes;
+        ews::internal::envelope_splitter splitter(
+            [&](std::vector<char>&& envelope) {
+                EXPECT_EQ('\0', envelope.back());
+                envelopes.emplace_back(&envelope[0]);
+                return true;
+            });
+        std::vector<char> out;
+        for (std::size_t pos = 0U; pos < response.size(); pos += chunk)
+        {
+            EXPECT_TRUE(splitter.feed(
+                &response[pos], std::min(chunk, response.size() - pos), out));
+        }
+        EXPECT_TRUE(out.empty());
+        ASSERT_EQ(3U, envelopes.size());
+        EXPECT_EQ("<s:Envelope><s:Body>a</s:Body></s:Envelope>", envelopes[0]);
+        EXPECT_EQ("\r\n<Envelope>b<!-- not </Envelope -->c</Envelope>",
+                  envelopes[1]);
+        EXPECT_EQ("<soap:Envelope><xEnvelope>d</xEnvelope></soap:Envelope>",
+                  envelopes[2]);
+    }
+}
+
+TEST(InternalTest, EnvelopeSplitterStopsWhenHandlerReturnsFalse)
+{
+    const std::string response = "<Envelope/></Envelope><Envelope/></Envelope>";
+    auto count = 0;
+    ews::internal::envelope_splitter splitter([&](std::vector<char>&&) {
+        ++count;
+        return false;
+    });
+    std::vector<char> out;
+    EXPECT_FALSE(splitter.feed(response.data(), response.size(), out));
+    EXPECT_EQ(1, count);
+}
+
+TEST(InternalTest, ItemSplitterHandsOverEachCompleteItem)
+{
+    const std::string response =
+        "<?xml version=\"1.0\"?>"
+        "<s:Envelope xmlns:s=\"urn:s\"><s:Body>"
+        "<m:FindItemResponse xmlns:m=\"urn:m\" xmlns:t=\"urn:t\">"
+        "<m:RootFolder TotalItemsInView=\"3\">"
+        "<t:Items>"
+        "<t:Message><t:ItemId Id=\"a\"/>"
+        "<t:Subject a=\"x>y\">one<!-- </t:Message> --></t:Subject>"
+        "</t:Message>"
+        "<t:Message xmlns:t=\"urn:other\"><t:Items/></t:Message>"
+        "<t:Contact/>"
+        "</t:Items>"
+        "</m:RootFolder>"
+        "</m:FindItemResponse>"
+        "</s:Body></s:Envelope>";
+    const std::string remainder =
+        "<?xml version=\"1.0\"?>"
+        "<s:Envelope xmlns:s=\"urn:s\"><s:Body>"
+        "<m:FindItemResponse xmlns:m=\"urn:m\" xmlns:t=\"urn:t\">"
+        "<m:RootFolder TotalItemsInView=\"3\">"
+        "<t:Items></t:Items>"
+        "</m:RootFolder>"
+        "</m:FindItemResponse>"
+        "</s:Body></s:Envelope>";
+    const std::string head =
+        "<Items xmlns:m=\"urn:m\" xmlns:t=\"urn:t\" xmlns:s=\"urn:s\">";
+
+    for (std::size_t chunk = 1U; chunk <= response.size(); chunk *= 2U)
+    {
+        std::vector<std::string> items;
+        ews::internal::item_splitter splitter([&](std::vector<char>&& item) {
+            EXPECT_EQ('\0', item.back());
+            items.emplace_back(&item[0]);
+            return true;
+        });
+        std::vector<char> out;
+        for (std::size_t pos = 0U; pos < response.size(); pos += chunk)
+        {
+            EXPECT_TRUE(splitter.feed(
+                &response[pos], std::min(chunk, response.size() - pos), out));
+        }
+        EXPECT_EQ(remainder, std::string(out.begin(), out.end()));
+        EXPECT_EQ(3U, splitter.items_handed_over());
+        ASSERT_EQ(3U, items.size());
+        EXPECT_EQ(head + "<t:Message><t:ItemId Id=\"a\"/>"
+                         "<t:Subject a=\"x>y\">one<!-- </t:Message> -->"
+                         "</t:Subject></t:Message></Items>",
+                  items[0]);
+        EXPECT_EQ(head + "<t:Message xmlns:t=\"urn:other\"><t:Items/>"
+                         "</t:Message></Items>",
+                  items[1]);
+        EXPECT_EQ(head + "<t:Contact/></Items>", items[2]);
+    }
+}
+
+TEST(InternalTest, ItemSplitterStopsWhenHandlerReturnsFalse)
+{
+    const std::string response = "<m:Items><t:Message/><t:Message/></m:Items>";
+    auto count = 0;
+    ews::internal::item_splitter splitter([&](std::vector<char>&&) {
+        ++count;
+        return false;
+    });
+    std::vector<char> out;
+    EXPECT_FALSE(splitter.feed(response.data(), response.size(), out));
+    EXPECT_EQ(1, count);
+}
+
+TEST(InternalTest, StreamedItemCanBeParsedOnItsOwn)
+{
+    const std::string xml =
+        "<Items xmlns:t=\"http://schemas.microsoft.com/exchange/services/"
+        "2006/types\">"
+        "<t:Message><t:ItemId Id=\"abc\" ChangeKey=\"def\"/>"
+        "<t:Subject>Mostly harmless</t:Subject></t:Message></Items>";
+    std::vector<char> buffer(xml.begin(), xml.end());
+    buffer.push_back('\0');
+    const auto msg =
+        ews::internal::parse_streamed_item<ews::message>(std::move(buffer));
+    EXPECT_EQ("abc", msg.get_item_id().id());
+    EXPECT_EQ("Mostly harmless", msg.get_subject());
+}
+
+#ifdef EWS_HAS_THREAD_LOCAL_STORAGE
+TEST(InternalTest, ResponseBufferIsRecycled)
+{
+    // Drain whatever an earlier test left behind
+    ews::internal::acquire_response_buffer();
+
+    std::vector<char> data(4096, 'x');
+    const auto capacity = data.capacity();
+    {
+        auto response = ews::internal::http_response(200, std::move(data));
+    }
+    const auto buffer = ews::internal::acquire_response_buffer();
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_EQ(capacity, buffer.capacity());
+
+    // Taken by the previous call
+    EXPECT_EQ(0U, ews::internal::acquire_response_buffer().capacity());
+}
+
+TEST(InternalTest, RequestBufferIsRecycled)
+{
+    ews::internal::acquire_request_buffer();
+
+    auto envelope = ews::internal::make_soap_envelope(
+        std::string(4096, 'x'), std::vector<std::string>());
+    const auto capacity = envelope.capacity();
+    ews::internal::recycle_request_buffer(envelope);
+
+    // The next envelope is built in the same memory
+    auto next = ews::internal::make_soap_envelope("<m:GetItem/>",
+                                                  std::vector<std::string>());
+    EXPECT_EQ(capacity, next.capacity());
+    EXPECT_NE(next.find("<soap:Body><m:GetItem/></soap:Body>"),
+              std::string::npos);
+}
+
+namespace
+{
+    // A response large enough to need more than the static memory pool
+    ews::internal::http_response make_large_response()
+    {
+        std::string xml = "<root>";
+        for (int i = 0; i < 5000; ++i)
+        {
+            xml += "<item id=\"" + std::to_string(i) + "\">text</item>";
+        }
+        xml += "</root>";
+        return ews::internal::http_response(
+            200, std::vector<char>(xml.c_str(), xml.c_str() + xml.size() + 1));
+    }
+
+    std::size_t blocks_allocated = 0U;
+    std::size_t blocks_freed = 0U;
+
+    void* counting_alloc(std::size_t size)
+    {
+        ++blocks_allocated;
+        return ::operator new(size);
+    }
+
+    void counting_free(void* ptr)
+    {
+        ++blocks_freed;
+        ::operator delete(ptr);
+    }
+}
+
+TEST(InternalTest, ParsedDocumentIsRecycled)
+{
+    ews::internal::xml_block_allocator::trim();
+
+    const rapidxml::xml_document<char>* first = nullptr;
+    {
+        auto response = make_large_response();
+        const auto doc = ews::internal::parse_response(std::move(response));
+        first = doc.get();
+    }
+    EXPECT_LT(0U, ews::internal::xml_block_allocator::cached_blocks());
+
+    // The next response is parsed into the same document
+    auto response = make_large_response();
+    const auto doc = ews::internal::parse_response(std::move(response));
+    EXPECT_EQ(first, doc.get());
+    ASSERT_NE(nullptr, doc->first_node());
+    EXPECT_STREQ("root", doc->first_node()->name());
+}
+
+TEST(InternalTest, CustomXmlAllocatorIsUsedForNewBlocks)
+{
+    ews::internal::xml_block_allocator::trim();
+    blocks_allocated = 0U;
+    blocks_freed = 0U;
+    ews::set_xml_allocator(&counting_alloc, &counting_free);
+    {
+        const auto doc =
+            ews::internal::parse_response_shared(make_large_response());
+        EXPECT_LT(0U, blocks_allocated);
+    }
+    ews::set_xml_allocator(nullptr, nullptr);
+
+    // Re-uses what the first response has left behind
+    const auto allocated = blocks_allocated;
+    {
+        const auto doc =
+            ews::internal::parse_response_shared(make_large_response());
+    }
+    EXPECT_EQ(allocated, blocks_allocated);
+    EXPECT_EQ(0U, blocks_freed);
+
+    // Blocks go back to the function they were allocated with
+    ews::internal::xml_block_allocator::trim();
+    EXPECT_EQ(0U, ews::internal::xml_block_allocator::cached_blocks());
+    EXPECT_EQ(blocks_allocated, blocks_freed);
+}
+#endif
+
+TEST(InternalTest, HttpRequestAcceptsTransportOptions)
+{
+    ews::internal::http_request request("https://example.com/ews");
+    ews::transport_options options;
+    options.accept_compressed_responses = true;
+    options.version = ews::http_version::http_1_1;
+    EXPECT_NO_THROW(request.set_transport_options(options));
+}
+
+TEST(InternalTest, HttpRequestRefusesCancelledToken)
+{
+    ews::internal::http_request request("http://127.0.0.1:1/");
+    ews::cancellation_token token;
+    token.cancel();
+    request.set_cancellation_token(token);
+    try
+    {
+        request.send("");
+        FAIL() << "Expected cancelled_error";
+    }
+    catch (ews::cancelled_error& exc)
+    {
+        EXPECT_FALSE(exc.deadline_exceeded());
+    }
+}
+
+TEST(InternalTest, HttpRequestRefusesExpiredDeadline)
+{
+    ews::internal::http_request request("http://127.0.0.1:1/");
+    request.set_cancellation_token(
+        ews::cancellation_token(std::chrono::milliseconds(0)));
+    try
+    {
+        request.send("");
+        FAIL() << "Expected cancelled_error";
+    }
+    catch (ews::cancelled_error& exc)
+    {
+        EXPECT_TRUE(exc.deadline_exceeded());
+    }
+}
+
+TEST(InternalTest, HttpRequestRejectsHeaderInjection)
+{
+    ews::internal::http_request request("http://127.0.0.1:1/");
+    EXPECT_THROW(request.set_header("X-AnchorMailbox", "a@b.c\r\nX-Evil: 1"),
+                 ews::exception);
+    EXPECT_THROW(request.set_header("X-AnchorMailbox", "a@b.c\n"),
+                 ews::exception);
+    EXPECT_NO_THROW(request.set_header("X-AnchorMailbox", "a@b.c"));
+}
+
+#ifdef EWS_USE_ZLIB
+TEST(InternalTest, GzipCompressedRequestInflatesToOriginal)
+{
+    std::string body = "<m:FindItem>";
+    for (int i = 0; i < 200; ++i)
+    {
+        body += "<t:FieldURI FieldURI=\"item:Subject\"/>";
+    }
+    body += "</m:FindItem>";
+
+    std::string compressed = "prefix";
+    ews::internal::gzip_compress(body.data(), body.size(), compressed);
+    ASSERT_EQ(0, compressed.compare(0, 6, "prefix"));
+    EXPECT_LT(compressed.size(), body.size() / 4U);
+    // gzip magic bytes
+    EXPECT_EQ('\x1f', compressed[6]);
+    EXPECT_EQ('\x8b', compressed[7]);
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    ASSERT_EQ(Z_OK, inflateInit2(&stream, 15 + 16));
+    std::string inflated(body.size() + 16U, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(&compressed[6]);
+    stream.avail_in = static_cast<uInt>(compressed.size() - 6U);
+    stream.next_out = reinterpret_cast<Bytef*>(&inflated[0]);
+    stream.avail_out = static_cast<uInt>(inflated.size());
+    EXPECT_EQ(Z_STREAM_END, inflate(&stream, Z_FINISH));
+    inflated.resize(stream.total_out);
+    inflateEnd(&stream);
+    EXPECT_EQ(body, inflated);
+}
+#else
+TEST(InternalTest, CompressingRequestsWithoutZlibThrows)
+{
+    ews::internal::http_request request("https://example.com/ews");
+    ews::transport_options options;
+    options.compress_requests = true;
+    EXPECT_THROW(request.set_transport_options(options), ews::exception);
+}
+#endif
 }
 
 // vim:et ts=4 sw=4
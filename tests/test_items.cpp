@@ -66,6 +66,16 @@ TEST(ItemIdTest, ToXMLWithNamespace)
     EXPECT_STREQ(expected, a.to_xml().c_str());
 }
 
+TEST(ItemIdTest, ToXMLAppendsToString)
+{
+    std::string str = "<m:ItemIds>";
+    item_id("a", "1").to_xml(str);
+    item_id("b", "2").to_xml(str);
+    EXPECT_STREQ("<m:ItemIds><t:ItemId Id=\"a\" ChangeKey=\"1\"/>"
+                 "<t:ItemId Id=\"b\" ChangeKey=\"2\"/>",
+                 str.c_str());
+}
+
 #pragma warning(suppress : 6262)
 TEST(ItemIdTest, FromAndToXMLRoundTrip)
 {
@@ -175,6 +185,61 @@ TEST(IndexedPropertyPath, ToXML)
                  path.to_xml().c_str());
 }
 
+TEST(PropertyPathTest, FieldDescriptorSplitsURI)
+{
+    const auto field =
+        ews::internal::field_descriptor("contacts:PhysicalAddress:City");
+    EXPECT_EQ(std::string("Contact"),
+              std::string(field.class_name(), field.class_name_size()));
+    EXPECT_EQ(std::string("City"),
+              std::string(field.local_name(), field.local_name_size()));
+    EXPECT_EQ(29U, field.uri_size());
+
+    const auto unknown = ews::internal::field_descriptor("some:string");
+    EXPECT_EQ(nullptr, unknown.class_name());
+    EXPECT_EQ(0U, unknown.class_name_size());
+}
+
+TEST(PropertyPathTest, PredefinedPathRefersToLiteral)
+{
+    const ews::property_path path = ews::item_property_path::subject;
+    EXPECT_STREQ("item:Subject", path.field().uri());
+    EXPECT_EQ(ews::item_property_path::subject.field().uri(),
+              path.field().uri());
+    EXPECT_STREQ("item:Subject", path.field_uri().c_str());
+}
+
+TEST(PropertyPathTest, RuntimeURIIsCopied)
+{
+    std::string uri = "calendar:Location";
+    const ews::property_path path = uri.c_str();
+    uri = "overwritten";
+    EXPECT_STREQ("<t:FieldURI FieldURI=\"calendar:Location\"/>",
+                 path.to_xml().c_str());
+    EXPECT_TRUE(path == ews::calendar_property_path::location);
+    EXPECT_FALSE(path == ews::calendar_property_path::when);
+}
+
+TEST(IndexedPropertyPath, PredefinedPathToXML)
+{
+    const ews::indexed_property_path& path =
+        ews::contact_property_path::phone_number::business_phone;
+    EXPECT_STREQ("<t:IndexedFieldURI FieldURI=\"contacts:PhoneNumber\" "
+                 "FieldIndex=\"BusinessPhone\"/>",
+                 path.to_xml().c_str());
+}
+
+TEST(IndexedPropertyPath, IndexFromBufferIsCopied)
+{
+    char index[32] = "Pager";
+    const ews::indexed_property_path path(
+        ews::internal::field_descriptor("contacts:PhoneNumber"), index);
+    std::strcpy(index, "Overwritten");
+    EXPECT_STREQ("<t:IndexedFieldURI FieldURI=\"contacts:PhoneNumber\" "
+                 "FieldIndex=\"Pager\"/>",
+                 path.to_xml().c_str());
+}
+
 TEST(OfflineItemTest, DefaultConstruction)
 {
     auto i = ews::item();
@@ -291,6 +356,112 @@ TEST(OfflineItemTest, GetDateTimeReceivedPropertyDefaultConstructed)
     EXPECT_EQ(ews::date_time(), task.get_date_time_received());
 }
 
+TEST(DateTimeTest, ParsesUtcDateTime)
+{
+    const auto dt = ews::date_time("2015-02-09T13:00:11Z");
+    EXPECT_TRUE(dt.has_time_point());
+    EXPECT_EQ(1423486811, dt.to_epoch());
+    EXPECT_EQ(std::chrono::system_clock::from_time_t(1423486811),
+              dt.to_time_point());
+    EXPECT_EQ("2015-02-09T13:00:11Z", dt.to_string());
+}
+
+TEST(DateTimeTest, AppliesTimeZoneOffset)
+{
+    EXPECT_EQ(ews::date_time("2015-02-09T13:00:11Z"),
+              ews::date_time("2015-02-09T14:30:11+01:30"));
+    EXPECT_EQ(ews::date_time("2015-02-09T13:00:11Z"),
+              ews::date_time("2015-02-09T08:00:11-05:00"));
+    EXPECT_EQ(ews::date_time("2015-02-09T13:00:11Z"),
+              ews::date_time("2015-02-09T13:00:11"));
+}
+
+TEST(DateTimeTest, ParsesDateAsMidnight)
+{
+    EXPECT_EQ(1423440000, ews::date_time("2015-02-09").to_epoch());
+    EXPECT_EQ(1423432800, ews::date_time("2015-02-09+02:00").to_epoch());
+}
+
+TEST(DateTimeTest, KeepsFractionalSeconds)
+{
+    const auto a = ews::date_time("2015-02-09T13:00:11.25Z");
+    const auto b = ews::date_time("2015-02-09T13:00:11.2500001Z");
+    EXPECT_EQ(a, b);
+    EXPECT_LT(ews::date_time("2015-02-09T13:00:11Z"), a);
+    EXPECT_EQ(1423486811, a.to_epoch());
+    EXPECT_EQ(std::chrono::microseconds(250000),
+              a.to_time_point() -
+                  std::chrono::system_clock::from_time_t(1423486811));
+}
+
+TEST(DateTimeTest, FormatsTimePointAsUtc)
+{
+    const auto when = std::chrono::system_clock::from_time_t(1423486811);
+    EXPECT_EQ("2015-02-09T13:00:11Z", ews::date_time(when).to_string());
+    EXPECT_EQ("2015-02-09T13:00:11.500Z",
+              ews::date_time(when + std::chrono::milliseconds(500))
+                  .to_string());
+    EXPECT_EQ("1969-12-31T23:59:59Z",
+              ews::date_time::from_epoch(-1).to_string());
+    EXPECT_EQ(-1, ews::date_time::from_epoch(-1).to_epoch());
+}
+
+TEST(DateTimeTest, ComparesByPointInTime)
+{
+    const auto earlier = ews::date_time("2015-02-09T14:00:00+02:00");
+    const auto later = ews::date_time("2015-02-09T13:00:00Z");
+    EXPECT_LT(earlier, later);
+    EXPECT_GT(later, earlier);
+    EXPECT_LE(earlier, earlier);
+    EXPECT_GE(later, earlier);
+    EXPECT_NE(earlier, later);
+}
+
+TEST(DateTimeTest, InvalidStringHasNoTimePoint)
+{
+    const auto dt = ews::date_time("yesterday");
+    EXPECT_FALSE(dt.has_time_point());
+    EXPECT_FALSE(ews::date_time().has_time_point());
+    EXPECT_FALSE(ews::date_time("2015-13-09T13:00:11Z").has_time_point());
+    EXPECT_FALSE(ews::date_time("2015-02-09T13:00:11Zx").has_time_point());
+    EXPECT_THROW(dt.to_epoch(), ews::exception);
+    EXPECT_THROW(dt.to_time_point(), ews::exception);
+
+    // 24:00:00 is allowed, but nothing after it
+    EXPECT_TRUE(ews::date_time("2015-02-09T24:00:00Z").has_time_point());
+    EXPECT_EQ(ews::date_time("2015-02-10T00:00:00Z"),
+              ews::date_time("2015-02-09T24:00:00Z"));
+    EXPECT_FALSE(ews::date_time("2015-02-09T24:30:00Z").has_time_point());
+    EXPECT_FALSE(ews::date_time("2015-02-09T24:00:01Z").has_time_point());
+    EXPECT_FALSE(
+        ews::date_time("2015-02-09T24:00:00.5Z").has_time_point());
+
+    // Days beyond the end of the month
+    EXPECT_FALSE(ews::date_time("2015-02-29T00:00:00Z").has_time_point());
+    EXPECT_FALSE(ews::date_time("2015-02-30T00:00:00Z").has_time_point());
+    EXPECT_FALSE(ews::date_time("2015-04-31T00:00:00Z").has_time_point());
+    EXPECT_FALSE(ews::date_time("1900-02-29").has_time_point());
+    EXPECT_TRUE(ews::date_time("2016-02-29T00:00:00Z").has_time_point());
+    EXPECT_TRUE(ews::date_time("2000-02-29").has_time_point());
+
+    EXPECT_EQ(ews::date_time("yesterday"), dt);
+    EXPECT_LT(dt, ews::date_time("2015-02-09T13:00:11Z"));
+}
+
+TEST(DateTimeTest, NoDateSentinelIsClampedToMaxTimePoint)
+{
+    // Exchange's "no date"; beyond system_clock's range if it counts
+    // nanoseconds
+    const auto no_date = ews::date_time("4501-01-01T00:00:00Z");
+    ASSERT_TRUE(no_date.has_time_point());
+    const auto tp = no_date.to_time_point();
+    EXPECT_GT(tp, ews::date_time("2262-01-01T00:00:00Z").to_time_point());
+    if (std::chrono::system_clock::duration::period::den > 1000000)
+    {
+        EXPECT_EQ(std::chrono::system_clock::time_point::max(), tp);
+    }
+}
+
 TEST_F(ItemTest, GetDateTimeReceivedProperty)
 {
     auto task = ews::task();
@@ -162,6 +162,21 @@ TEST(RestrictionTest, IsEqualToDateTimeConstantRendersCorrectly)
     EXPECT_STREQ(expected, restr.to_xml().c_str());
 }
 
+TEST(RestrictionTest, IsGreaterThanTimePointRendersAsUtc)
+{
+    const char* expected = "<t:IsGreaterThan>"
+                           "<t:FieldURI FieldURI=\"item:DateTimeReceived\"/>"
+                           "<t:FieldURIOrConstant>"
+                           "<t:Constant Value=\"2015-05-28T17:39:11Z\"/>"
+                           "</t:FieldURIOrConstant>"
+                           "</t:IsGreaterThan>";
+
+    const auto when = std::chrono::system_clock::from_time_t(1432834751);
+    auto restr = ews::is_greater_than(
+        ews::item_property_path::date_time_received, ews::date_time(when));
+    EXPECT_STREQ(expected, restr.to_xml().c_str());
+}
+
 TEST(RestrictionTest, IndexedFieldURIIsEqualToStringConstantRendersCorrectly)
 {
     const char* expected = "<t:IsEqualTo>"
@@ -236,6 +251,112 @@ TEST(RestrictionTest, IsGreaterThanOrEqualToIntConstantRendersCorrectly)
         ews::task_property_path::percent_complete, 80);
     EXPECT_STREQ(expected, restr.to_xml().c_str());
 }
+
+TEST(RestrictionTest, PreparedExpressionRendersLikeOriginal)
+{
+    using ews::and_;
+    using ews::contains;
+    using ews::is_equal_to;
+
+    auto restr = and_(is_equal_to(ews::task_property_path::is_complete, true),
+                      contains(ews::item_property_path::subject, "Baseball"));
+    const auto prepared = ews::prepared_search_expression(restr);
+    EXPECT_TRUE(prepared.parameters().empty());
+    EXPECT_TRUE(prepared.is_bound());
+    EXPECT_EQ(restr.to_xml(), prepared.to_xml());
+    EXPECT_EQ(restr.to_xml(), prepared.to_xml());
+}
+
+TEST(RestrictionTest, PreparedExpressionSplicesBoundParameters)
+{
+    const char* expected = "<t:And>"
+                           "<t:IsGreaterThan>"
+                           "<t:FieldURI FieldURI=\"item:DateTimeReceived\"/>"
+                           "<t:FieldURIOrConstant>"
+                           "<t:Constant Value=\"2015-05-28T17:39:11Z\"/>"
+                           "</t:FieldURIOrConstant>"
+                           "</t:IsGreaterThan>"
+                           "<t:IsLessThan>"
+                           "<t:FieldURI FieldURI=\"item:Size\"/>"
+                           "<t:FieldURIOrConstant>"
+                           "<t:Constant Value=\"1024\"/>"
+                           "</t:FieldURIOrConstant>"
+                           "</t:IsLessThan>"
+                           "</t:And>";
+
+    const auto prepared = ews::prepared_search_expression(ews::and_(
+        ews::is_greater_than(ews::item_property_path::date_time_received,
+                             ews::search_parameter("since")),
+        ews::is_less_than(ews::item_property_path::size,
+                          ews::search_parameter("size"))));
+    ASSERT_EQ(2U, prepared.parameters().size());
+    EXPECT_EQ("since", prepared.parameters()[0]);
+    EXPECT_EQ("size", prepared.parameters()[1]);
+
+    const auto bound =
+        prepared.bind("since", ews::date_time("2015-05-28T17:39:11Z"))
+            .bind("size", 1024);
+    EXPECT_TRUE(bound.is_bound());
+    EXPECT_STREQ(expected, bound.to_xml().c_str());
+
+    // Binding returns a copy, the prepared expression is left untouched
+    EXPECT_FALSE(prepared.is_bound());
+}
+
+TEST(RestrictionTest, PreparedExpressionBindsRepeatedParameterEverywhere)
+{
+    const auto prepared = ews::prepared_search_expression(
+        ews::or_(ews::is_equal_to(ews::item_property_path::subject,
+                                  ews::search_parameter("subject")),
+                 ews::is_equal_to(ews::item_property_path::in_reply_to,
+                                  ews::search_parameter("subject"))));
+    ASSERT_EQ(1U, prepared.parameters().size());
+
+    const auto xml = prepared.bind("subject", "Vogon poetry").to_xml();
+    const auto first = xml.find("Vogon poetry");
+    ASSERT_NE(std::string::npos, first);
+    EXPECT_NE(std::string::npos, xml.find("Vogon poetry", first + 1U));
+}
+
+TEST(RestrictionTest, PreparedExpressionWithUnboundParameterThrows)
+{
+    const auto prepared = ews::prepared_search_expression(
+        ews::is_greater_than(ews::item_property_path::date_time_received,
+                             ews::search_parameter("since")));
+    EXPECT_FALSE(prepared.is_bound());
+    EXPECT_THROW(prepared.to_xml(), ews::exception);
+    EXPECT_THROW(prepared.bind("until", "2015-05-28T17:39:11Z"),
+                 ews::exception);
+}
+
+TEST(RestrictionTest, PreparedExpressionEscapesBoundValues)
+{
+    const auto prepared = ews::prepared_search_expression(
+        ews::is_equal_to(ews::item_property_path::subject,
+                         ews::search_parameter("subject")));
+    const auto xml = prepared.bind("subject", "a\"<b&").to_xml();
+    EXPECT_NE(std::string::npos,
+              xml.find("<t:Constant Value=\"a&quot;&lt;b&amp;\"/>"));
+    EXPECT_EQ(std::string::npos, xml.find("a\"<b&"));
+}
+
+TEST(RestrictionTest, PreparedExpressionBindsAllIntegerTypes)
+{
+    const auto prepared = ews::prepared_search_expression(ews::is_less_than(
+        ews::item_property_path::size, ews::search_parameter("size")));
+    const auto expected = prepared.bind("size", 1024).to_xml();
+    EXPECT_EQ(expected, prepared.bind("size", 1024L).to_xml());
+    EXPECT_EQ(expected, prepared.bind("size", 1024LL).to_xml());
+    EXPECT_EQ(expected, prepared.bind("size", 1024U).to_xml());
+    EXPECT_EQ(expected, prepared.bind("size", 1024UL).to_xml());
+    EXPECT_EQ(expected, prepared.bind("size", 1024ULL).to_xml());
+}
+
+TEST(RestrictionTest, InvalidSearchParameterNameThrows)
+{
+    EXPECT_THROW(ews::search_parameter(""), ews::exception);
+    EXPECT_THROW(ews::search_parameter("a\x1f"), ews::exception);
+}
 }
 
 // vim:et ts=4 sw=4
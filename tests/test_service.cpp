@@ -17,11 +17,19 @@
 
 #include "fixtures.hpp"
 
+#include <ews/ews_replay.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <fstream>
+#include <future>
 #include <ios>
 #include <iostream>
 #include <iterator>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 #include <utility>
 
 #ifdef EWS_USE_BOOST_LIBRARY
@@ -226,125 +234,2864 @@ TEST_F(RequestServerVersionTest, DefaultServerVersionIs2013_SP1)
               ews::server_version::exchange_2013_sp1);
 }
 
-class ServiceTest : public ContactTest
+// Re-uses the CreateItem response
+class ImpersonationTest : public RequestServerVersionTest
 {
+public:
+    static const std::string* anchor_mailbox()
+    {
+        const auto& headers = http_request_mock::storage::instance().headers;
+        auto it = headers.find("X-AnchorMailbox");
+        return it == headers.end() ? nullptr : &it->second;
+    }
 };
 
-TEST_F(ServiceTest, UpdateItemOfReadOnlyPropertyThrows)
+TEST_F(ImpersonationTest, ConnectingSidToXml)
 {
-    auto minnie = test_contact();
-    ASSERT_FALSE(minnie.has_attachments());
-    auto prop = ews::property(ews::item_property_path::has_attachments, true);
-    EXPECT_THROW({ service().update_item(minnie.get_item_id(), prop); },
-                 ews::exchange_error);
+    ews::connecting_sid sid(ews::connecting_sid::type::primary_smtp_address,
+                            "dduck@duckburg.com");
+    EXPECT_EQ("<t:ConnectingSID><t:PrimarySmtpAddress>dduck@duckburg.com"
+              "</t:PrimarySmtpAddress></t:ConnectingSID>",
+              sid.to_xml());
+
+    ews::connecting_sid escaped(ews::connecting_sid::type::principal_name,
+                                "d&d@duckburg.com");
+    EXPECT_EQ("<t:ConnectingSID><t:PrincipalName>d&amp;d@duckburg.com"
+              "</t:PrincipalName></t:ConnectingSID>",
+              escaped.to_xml());
+
+    EXPECT_THROW(ews::connecting_sid(ews::connecting_sid::type::sid, ""),
+                 ews::exception);
 }
 
-TEST_F(ServiceTest, UpdateItemOfReadOnlyPropertyThrowsWhatMessage)
+TEST_F(ImpersonationTest, NotImpersonatingByDefault)
 {
-    auto minnie = test_contact();
-    ASSERT_FALSE(minnie.has_attachments());
-    auto prop = ews::property(ews::item_property_path::has_attachments, true);
-    try
+    EXPECT_FALSE(service().is_impersonating());
+    service().create_item(ews::task());
+    EXPECT_FALSE(get_last_request().header_contains("ExchangeImpersonation"));
+}
+
+TEST_F(ImpersonationTest, RequestsCarryImpersonationHeaders)
+{
+    service().impersonate(ews::connecting_sid(
+        ews::connecting_sid::type::smtp_address, "gus@duckburg.com"));
+    EXPECT_TRUE(service().is_impersonating());
+    service().create_item(ews::task());
+
+    EXPECT_TRUE(get_last_request().header_contains(
+        "<t:ExchangeImpersonation><t:ConnectingSID>"
+        "<t:SmtpAddress>gus@duckburg.com</t:SmtpAddress>"
+        "</t:ConnectingSID></t:ExchangeImpersonation>"));
+    EXPECT_TRUE(get_last_request().header_contains(
+        "<t:RequestServerVersion Version=\"Exchange2013_SP1\"/>"));
+    ASSERT_NE(nullptr, anchor_mailbox());
+    EXPECT_EQ("gus@duckburg.com", *anchor_mailbox());
+}
+
+TEST_F(ImpersonationTest, SidIsNotUsedAsAnchorMailbox)
+{
+    service().impersonate(ews::connecting_sid(
+        ews::connecting_sid::type::smtp_address, "gus@duckburg.com"));
+    service().impersonate(ews::connecting_sid(
+        ews::connecting_sid::type::sid, "S-1-5-21-1234"));
+    service().create_item(ews::task());
+
+    EXPECT_TRUE(get_last_request().header_contains(
+        "<t:SID>S-1-5-21-1234</t:SID>"));
+    EXPECT_EQ(nullptr, anchor_mailbox());
+}
+
+TEST_F(ImpersonationTest, RejectsControlCharactersInAnchorMailbox)
+{
+    EXPECT_THROW(service().impersonate(ews::connecting_sid(
+                     ews::connecting_sid::type::smtp_address,
+                     "gus@duckburg.com\r\nX-Injected: yes")),
+                 ews::exception);
+    EXPECT_FALSE(service().is_impersonating());
+    EXPECT_EQ(nullptr, anchor_mailbox());
+}
+
+TEST_F(ImpersonationTest, StopImpersonating)
+{
+    service().impersonate(ews::connecting_sid(
+        ews::connecting_sid::type::smtp_address, "gus@duckburg.com"));
+    service().stop_impersonating();
+    EXPECT_FALSE(service().is_impersonating());
+    service().create_item(ews::task());
+
+    EXPECT_FALSE(get_last_request().header_contains("ExchangeImpersonation"));
+    EXPECT_EQ(nullptr, anchor_mailbox());
+}
+
+class ServicePoolTest : public BaseFixture
+{
+public:
+    typedef ews::basic_service_pool<http_request_mock> pool_type;
+
+    ServicePoolTest()
+        : pool_("https://example.com/ews/Exchange.asmx", "FAKEDOMAIN",
+                "fakeuser", "fakepassword", 2U)
     {
-        service().update_item(minnie.get_item_id(), prop);
-        FAIL() << "Expected exception to be thrown";
     }
-    catch (ews::exchange_error& exc)
+
+    pool_type& pool() { return pool_; }
+
+private:
+    pool_type pool_;
+};
+
+TEST_F(ServicePoolTest, ZeroSizeThrows)
+{
+    EXPECT_THROW(
+        {
+            pool_type p("https://example.com/ews/Exchange.asmx", "FAKEDOMAIN",
+                        "fakeuser", "fakepassword", 0U);
+        },
+        ews::exception);
+}
+
+TEST_F(ServicePoolTest, AcquireAndRelease)
+{
+    EXPECT_EQ(2U, pool().size());
+    EXPECT_EQ(2U, pool().available());
     {
-        EXPECT_STREQ("ErrorInvalidPropertySet", exc.what());
+        auto first = pool().acquire();
+        EXPECT_EQ(1U, pool().available());
+        auto second = pool().acquire();
+        EXPECT_EQ(0U, pool().available());
+        EXPECT_NE(first.get(), second.get());
     }
+    EXPECT_EQ(2U, pool().available());
 }
 
-TEST_F(ServiceTest, UpdateItemWithSetItemField)
+TEST_F(ServicePoolTest, ReusesIdleService)
 {
-    // <SetItemField> is used whenever we want to replace an existing value.
-    // If none exists yet, it is created
+    auto first = pool().acquire();
+    const auto ptr = first.get();
+    first = pool().acquire(); // Old service goes back to the pool
+    EXPECT_EQ(1U, pool().available());
+    auto lease = pool().acquire();
+    EXPECT_EQ(ptr, lease.get());
+}
 
-    auto minnie = test_contact();
+TEST_F(ServicePoolTest, MovedFromLeaseDoesNotReturnService)
+{
+    auto first = pool().acquire();
+    {
+        auto moved = std::move(first);
+        EXPECT_EQ(1U, pool().available());
+    }
+    EXPECT_EQ(2U, pool().available());
+}
 
-    EXPECT_STREQ("Mickey", minnie.get_spouse_name().c_str());
-    auto spouse_name_property =
-        ews::property(ews::contact_property_path::spouse_name, "Mickey");
-    auto new_id =
-        service().update_item(minnie.get_item_id(), spouse_name_property,
-                              ews::conflict_resolution::auto_resolve);
-    minnie = service().get_contact(new_id);
-    EXPECT_STREQ("Mickey", minnie.get_spouse_name().c_str());
+TEST_F(ServicePoolTest, AcquireBlocksUntilServiceIsReturned)
+{
+    auto first = pool().acquire();
+    auto second = pool().acquire();
+    const auto ptr = second.get();
 
-    spouse_name_property =
-        ews::property(ews::contact_property_path::spouse_name, "Peg-Leg Pedro");
-    new_id = service().update_item(minnie.get_item_id(), spouse_name_property,
-                                   ews::conflict_resolution::auto_resolve);
-    minnie = service().get_contact(new_id);
-    EXPECT_STREQ("Peg-Leg Pedro", minnie.get_spouse_name().c_str());
+    std::atomic<bool> acquired(false);
+    std::thread worker([&] {
+        auto third = pool().acquire();
+        acquired = true;
+        EXPECT_EQ(ptr, third.get());
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(acquired);
+    {
+        auto returned = std::move(second);
+    }
+    worker.join();
+    EXPECT_TRUE(acquired);
 }
 
-TEST_F(ServiceTest, UpdateItemWithDeleteItemField)
+TEST_F(ServicePoolTest, ImpersonationEndsWithLease)
 {
-    // <DeleteItemField> is simply just a FieldURI to the property that we
-    // want to delete. Not much to it. It is automatically deduced by
-    // service::update_item if the user has not provided any value to the
-    // property he wanted to update
+    pool_type::service_type* ptr = nullptr;
+    {
+        auto lease = pool().acquire(ews::connecting_sid(
+            ews::connecting_sid::type::primary_smtp_address,
+            "gus@duckburg.com"));
+        EXPECT_TRUE(lease->is_impersonating());
+        ptr = lease.get();
+    }
+    auto lease = pool().acquire();
+    EXPECT_EQ(ptr, lease.get());
+    EXPECT_FALSE(lease->is_impersonating());
+}
 
-    auto minnie = test_contact();
-    ASSERT_FALSE(minnie.get_given_name().empty());
-    auto prop = ews::property(ews::contact_property_path::given_name, "");
-    auto update = ews::update(prop, ews::update::operation::delete_item_field);
-    auto new_id = service().update_item(minnie.get_item_id(), update);
-    minnie = service().get_contact(new_id);
-    EXPECT_TRUE(minnie.get_given_name().empty());
+TEST_F(ServicePoolTest, LeasedServiceSendsRequests)
+{
+    auto& storage = http_request_mock::storage::instance();
+    const char* response =
+        "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+        "<s:Body>"
+        "<m:CreateItemResponse "
+        "xmlns:m=\"http://schemas.microsoft.com/exchange/services/2006/"
+        "messages\" "
+        "xmlns:t=\"http://schemas.microsoft.com/exchange/services/2006/"
+        "types\">"
+        "<m:ResponseMessages>"
+        "<m:CreateItemResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Items>"
+        "<t:Task><t:ItemId Id=\"abc\" ChangeKey=\"def\"/></t:Task>"
+        "</m:Items>"
+        "</m:CreateItemResponseMessage>"
+        "</m:ResponseMessages>"
+        "</m:CreateItemResponse>"
+        "</s:Body>"
+        "</s:Envelope>";
+    storage.fake_response =
+        std::vector<char>(response, response + std::strlen(response) + 1);
+
+    auto srv = pool().acquire();
+    auto task = ews::task();
+    task.set_subject("Water the plants");
+    const auto id = srv->create_item(task);
+    EXPECT_EQ("abc", id.id());
+    EXPECT_NE(storage.request_string.find("<m:CreateItem"), std::string::npos);
+    EXPECT_EQ("https://example.com/ews/Exchange.asmx", storage.url);
 }
 
-TEST_F(ServiceTest, UpdateItemWithAppendToItemField)
+class AsyncServiceTest : public FakeServiceFixture
 {
-    // <AppendToItemField> is automatically deduced by service::update_item
-    // so user does not need to bother. It is only valid for following
-    // properties (at least in EWS 2007 slang):
-    //
-    // - calendar:OptionalAttendees
-    // - calendar:RequiredAttendees
-    // - calendar:Resources
-    // - item:Body
-    // - message:ToRecipients
-    // - message:CcRecipients
-    // - message:BccRecipients
-    // - message:ReplyTo
+public:
+    ews::async_engine& engine() { return engine_; }
 
-    auto message = ews::message();
-    message.set_subject("You are hiding again, aren't you?");
-    std::vector<ews::mailbox> recipients;
-    recipients.push_back(ews::mailbox("darkwing.duck@duckburg.com"));
-    message.set_to_recipients(recipients);
-    auto item_id =
-        service().create_item(message, ews::message_disposition::save_only);
-    on_scope_exit delete_message(
-        [&] { service().delete_message(std::move(message)); });
-    message = service().get_message(item_id);
-    recipients = message.get_to_recipients();
-    EXPECT_EQ(1U, recipients.size());
+    // Wraps given response message in a SOAP envelope
+    void set_next_fake_response_message(const std::string& operation,
+                                        const std::string& message)
+    {
+        set_next_fake_response(
+            make_response_envelope(operation, message).c_str());
+    }
 
-    std::vector<ews::mailbox> additional_recipients;
-    additional_recipients.push_back(ews::mailbox("gus.goose@duckburg.com"));
-    auto prop = ews::property(ews::message_property_path::to_recipients,
-                              additional_recipients);
-    auto change =
-        ews::update(prop, ews::update::operation::append_to_item_field);
-    auto new_id = service().update_item(message.get_item_id(), change);
-    message = service().get_message(item_id);
-    ASSERT_EQ(2U, message.get_to_recipients().size());
+    static std::string make_response_envelope(const std::string& operation,
+                                              const std::string& message)
+    {
+        return "<s:Envelope "
+            "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+            "<s:Body>"
+            "<m:" +
+            operation + "Response "
+                        "xmlns:m=\"http://schemas.microsoft.com/exchange/"
+                        "services/2006/messages\" "
+                        "xmlns:t=\"http://schemas.microsoft.com/exchange/"
+                        "services/2006/types\">"
+                        "<m:ResponseMessages>" +
+            message + "</m:ResponseMessages>"
+                      "</m:" +
+            operation + "Response>"
+                        "</s:Body>"
+                        "</s:Envelope>";
+    }
+
+private:
+    ews::async_engine engine_;
+};
+
+TEST_F(AsyncServiceTest, ThrowsWithoutEngine)
+{
+    EXPECT_THROW(
+        {
+            service().find_item_async(
+                ews::distinguished_folder_id(ews::standard_folder::inbox));
+        },
+        ews::exception);
 }
 
-TEST_F(ServiceTest, SendItem)
+TEST_F(AsyncServiceTest, CreateItemAsync)
 {
-    auto msg = ews::message();
-    msg.set_subject("You are hiding again, aren't you?");
-    std::vector<ews::mailbox> recipients;
-    recipients.push_back(ews::mailbox("darkwing.duck@duckburg.com"));
-    msg.set_to_recipients(recipients);
-    const auto item_id =
-        service().create_item(msg, ews::message_disposition::save_only);
-    msg = service().get_message(item_id);
-    EXPECT_NO_THROW({ service().send_item(msg.get_item_id()); });
+    set_next_fake_response_message(
+        "CreateItem", "<m:CreateItemResponseMessage ResponseClass=\"Success\">"
+                      "<m:ResponseCode>NoError</m:ResponseCode>"
+                      "<m:Items>"
+                      "<t:Task><t:ItemId Id=\"abc\" ChangeKey=\"def\"/></t:Task>"
+                      "</m:Items>"
+                      "</m:CreateItemResponseMessage>");
+    service().set_async_engine(engine());
+    auto task = ews::task();
+    task.set_subject("Clean the windows");
+    auto future = service().create_item_async(task);
+    const auto id = future.get();
+    EXPECT_EQ("abc", id.id());
+    EXPECT_EQ("def", id.change_key());
+    EXPECT_NE(get_last_request().request_string().find("<m:CreateItem"),
+              std::string::npos);
+}
+
+TEST_F(AsyncServiceTest, GetTaskAsync)
+{
+    set_next_fake_response_message(
+        "GetItem", "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+                   "<m:ResponseCode>NoError</m:ResponseCode>"
+                   "<m:Items>"
+                   "<t:Task>"
+                   "<t:ItemId Id=\"abc\" ChangeKey=\"def\"/>"
+                   "<t:Subject>Clean the windows</t:Subject>"
+                   "</t:Task>"
+                   "</m:Items>"
+                   "</m:GetItemResponseMessage>");
+    service().set_async_engine(engine());
+    auto task = service().get_task_async(ews::item_id("abc", "def")).get();
+    EXPECT_EQ("Clean the windows", task.get_subject());
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<t:BaseShape>AllProperties</t:BaseShape>"),
+              std::string::npos);
+}
+
+TEST_F(AsyncServiceTest, ErrorIsReportedThroughFuture)
+{
+    set_next_fake_response_message(
+        "GetItem", "<m:GetItemResponseMessage ResponseClass=\"Error\">"
+                   "<m:MessageText>The specified object was not found in "
+                   "the store.</m:MessageText>"
+                   "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+                   "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+                   "<m:Items/>"
+                   "</m:GetItemResponseMessage>");
+    service().set_async_engine(engine());
+    auto future = service().get_message_async(ews::item_id("abc", "def"));
+    EXPECT_THROW(future.get(), ews::exchange_error);
+}
+
+TEST_F(AsyncServiceTest, DeleteItemAsync)
+{
+    set_next_fake_response_message(
+        "DeleteItem",
+        "<m:DeleteItemResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "</m:DeleteItemResponseMessage>");
+    service().set_async_engine(engine());
+    auto future = service().delete_item_async(ews::item_id("abc", "def"));
+    EXPECT_NO_THROW(future.get());
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<t:ItemId Id=\"abc\" ChangeKey=\"def\"/>"),
+              std::string::npos);
+}
+
+class BatchGetItemTest : public AsyncServiceTest
+{
+public:
+    // A <GetItemResponse> with a successful and a failed message
+    void set_next_fake_response_for_two_items()
+    {
+        set_next_fake_response_message(
+            "GetItem",
+            "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+            "<m:ResponseCode>NoError</m:ResponseCode>"
+            "<m:Items>"
+            "<t:Task>"
+            "<t:ItemId Id=\"abc\" ChangeKey=\"def\"/>"
+            "<t:Subject>Feed the cat</t:Subject>"
+            "</t:Task>"
+            "</m:Items>"
+            "</m:GetItemResponseMessage>"
+            "<m:GetItemResponseMessage ResponseClass=\"Error\">"
+            "<m:MessageText>The specified object was not found in "
+            "the store.</m:MessageText>"
+            "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+            "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+            "<m:Items/>"
+            "</m:GetItemResponseMessage>");
+    }
+
+    std::vector<ews::item_id> make_ids(int count)
+    {
+        std::vector<ews::item_id> ids;
+        for (int i = 0; i < count; ++i)
+        {
+            ids.emplace_back(ews::item_id("id" + std::to_string(i)));
+        }
+        return ids;
+    }
+};
+
+TEST_F(BatchGetItemTest, SplitsRequestIntoChunks)
+{
+    set_next_fake_response_for_two_items();
+    auto options = ews::batch_options();
+    options.chunk_size = 2U;
+    const auto results = service().get_items<ews::task>(
+        make_ids(4), ews::base_shape::all_properties, options);
+
+    // Last request only contains last chunk
+    const auto& request = get_last_request().request_string();
+    EXPECT_EQ(std::string::npos, request.find("\"id1\""));
+    EXPECT_NE(std::string::npos, request.find("\"id2\""));
+    EXPECT_NE(std::string::npos, request.find("\"id3\""));
+
+    ASSERT_EQ(4U, results.size());
+    for (std::size_t i = 0U; i < results.size(); i += 2)
+    {
+        EXPECT_TRUE(results[i].success());
+        EXPECT_EQ("Feed the cat", results[i].get_item().get_subject());
+        EXPECT_FALSE(results[i + 1].success());
+        EXPECT_EQ(ews::response_code::error_item_not_found,
+                  results[i + 1].get_response_code());
+    }
+}
+
+TEST_F(BatchGetItemTest, SendsChunksThroughAsyncEngine)
+{
+    set_next_fake_response_for_two_items();
+    service().set_async_engine(engine());
+    auto options = ews::batch_options();
+    options.chunk_size = 2U;
+    options.max_parallel_requests = 2U;
+    const auto results = service().get_items<ews::task>(
+        make_ids(6), ews::base_shape::all_properties, options);
+    ASSERT_EQ(6U, results.size());
+    EXPECT_TRUE(results[4].success());
+    EXPECT_FALSE(results[5].success());
+}
+
+TEST_F(BatchGetItemTest, IncludesAdditionalProperties)
+{
+    set_next_fake_response_for_two_items();
+    auto additional_props = std::vector<ews::property_path>();
+    additional_props.push_back(ews::item_property_path::body);
+    auto options = ews::batch_options();
+    options.chunk_size = 2U;
+    service().get_items<ews::task>(make_ids(2), ews::base_shape::id_only,
+                                   additional_props, options);
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<t:AdditionalProperties>"
+                  "<t:FieldURI FieldURI=\"item:Body\"/>"
+                  "</t:AdditionalProperties>"),
+              std::string::npos);
+}
+
+TEST_F(BatchGetItemTest, ThrowsOnUnexpectedNumberOfResponseMessages)
+{
+    set_next_fake_response_for_two_items();
+    auto options = ews::batch_options();
+    options.chunk_size = 3U;
+    EXPECT_THROW(service().get_items<ews::task>(
+                     make_ids(3), ews::base_shape::all_properties, options),
+                 ews::exception);
+}
+
+class BatchWriteItemTest : public BatchGetItemTest
+{
+public:
+    // A response with a successful and a failed message for given
+    // operation
+    void set_next_fake_response_for_two_writes(const std::string& operation)
+    {
+        set_next_fake_response_message(
+            operation,
+            "<m:" + operation +
+                "ResponseMessage ResponseClass=\"Success\">"
+                "<m:ResponseCode>NoError</m:ResponseCode>"
+                "<m:Items>"
+                "<t:Task><t:ItemId Id=\"new\" ChangeKey=\"ck\"/></t:Task>"
+                "</m:Items>"
+                "</m:" +
+                operation + "ResponseMessage>"
+                            "<m:" +
+                operation +
+                "ResponseMessage ResponseClass=\"Error\">"
+                "<m:MessageText>The specified object was not found in "
+                "the store.</m:MessageText>"
+                "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+                "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+                "<m:Items/>"
+                "</m:" +
+                operation + "ResponseMessage>");
+    }
+};
+
+TEST_F(BatchWriteItemTest, CreateItemsSendsManyItemsPerRequest)
+{
+    set_next_fake_response_for_two_writes("CreateItem");
+    std::vector<ews::task> tasks(4);
+    for (std::size_t i = 0U; i < tasks.size(); ++i)
+    {
+        tasks[i].set_subject("task" + std::to_string(i));
+    }
+    auto options = ews::batch_options();
+    options.chunk_size = 2U;
+    const auto results = service().create_items(tasks, options);
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_EQ(std::string::npos, request.find("task1"));
+    EXPECT_NE(std::string::npos,
+              request.find("<m:CreateItem><m:Items><t:Task>"));
+    EXPECT_NE(std::string::npos, request.find("task2"));
+    EXPECT_NE(std::string::npos, request.find("task3"));
+
+    ASSERT_EQ(4U, results.size());
+    EXPECT_TRUE(results[2].success());
+    EXPECT_EQ("new", results[2].get_item().id());
+    EXPECT_FALSE(results[3].success());
+    EXPECT_EQ(ews::response_code::error_item_not_found,
+              results[3].get_response_code());
+}
+
+TEST_F(BatchWriteItemTest, CreateItemsSetsMessageDisposition)
+{
+    set_next_fake_response_for_two_writes("CreateItem");
+    service().create_items(std::vector<ews::message>(2),
+                           ews::message_disposition::save_only);
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<m:CreateItem MessageDisposition=\"SaveOnly\"><m:Items>"
+                  "<t:Message>"),
+              std::string::npos);
+}
+
+TEST_F(BatchWriteItemTest, UpdateItemsSendsOneItemChangePerItem)
+{
+    set_next_fake_response_for_two_writes("UpdateItem");
+    service().set_async_engine(engine());
+    std::vector<std::pair<ews::item_id, std::vector<ews::update>>> changes;
+    for (const auto& id : make_ids(4))
+    {
+        auto prop = ews::property(ews::item_property_path::subject, "s");
+        changes.emplace_back(id, std::vector<ews::update>{ews::update(prop)});
+    }
+    auto options = ews::batch_options();
+    options.chunk_size = 2U;
+    const auto results = service().update_items(
+        changes, ews::conflict_resolution::always_overwrite,
+        ews::send_meeting_cancellations::send_to_none, options);
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(std::string::npos,
+              request.find("ConflictResolution=\"AlwaysOverwrite\""));
+    EXPECT_NE(std::string::npos,
+              request.find("<t:ItemChange><t:ItemId Id=\"id3\""));
+    ASSERT_EQ(4U, results.size());
+    EXPECT_TRUE(results[0].success());
+    EXPECT_EQ("ck", results[0].get_item().change_key());
+    EXPECT_FALSE(results[1].success());
+}
+
+TEST_F(BatchWriteItemTest, DeleteItemsReturnsRequestedIds)
+{
+    set_next_fake_response_message(
+        "DeleteItem",
+        "<m:DeleteItemResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "</m:DeleteItemResponseMessage>"
+        "<m:DeleteItemResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>The specified object was not found in "
+        "the store.</m:MessageText>"
+        "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "</m:DeleteItemResponseMessage>");
+    const auto results = service().delete_items(make_ids(2));
+
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<m:ItemIds><t:ItemId Id=\"id0\" ChangeKey=\"\"/>"
+                  "<t:ItemId Id=\"id1\" ChangeKey=\"\"/></m:ItemIds>"),
+              std::string::npos);
+    ASSERT_EQ(2U, results.size());
+    EXPECT_TRUE(results[0].success());
+    EXPECT_EQ("id0", results[0].get_item().id());
+    EXPECT_FALSE(results[1].success());
+    EXPECT_EQ("id1", results[1].get_item().id());
+}
+
+TEST_F(BatchWriteItemTest, CreateAttachmentsSendsOneRequest)
+{
+    set_next_fake_response_message(
+        "CreateAttachment",
+        "<m:CreateAttachmentResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Attachments>"
+        "<t:FileAttachment><t:AttachmentId Id=\"a1\" RootItemId=\"r\" "
+        "RootItemChangeKey=\"k\"/></t:FileAttachment>"
+        "</m:Attachments>"
+        "</m:CreateAttachmentResponseMessage>"
+        "<m:CreateAttachmentResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>The attachment is too large.</m:MessageText>"
+        "<m:ResponseCode>ErrorAttachmentSizeLimitExceeded</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "<m:Attachments><t:FileAttachment/></m:Attachments>"
+        "</m:CreateAttachmentResponseMessage>"
+        "<m:CreateAttachmentResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Attachments>"
+        "<t:FileAttachment><t:AttachmentId Id=\"a3\" RootItemId=\"r\" "
+        "RootItemChangeKey=\"k\"/></t:FileAttachment>"
+        "</m:Attachments>"
+        "</m:CreateAttachmentResponseMessage>");
+    const auto results = service().create_attachments(
+        ews::item_id("r&", "k\""),
+        std::vector<ews::attachment>(3, ews::attachment()));
+
+    ASSERT_EQ(3U, results.size());
+    EXPECT_TRUE(results[0].success());
+    EXPECT_EQ("a1", results[0].get_item().id());
+    EXPECT_FALSE(results[1].success());
+    EXPECT_EQ(ews::response_code::error_attachment_size_limit_exceeded,
+              results[1].get_response_code());
+    EXPECT_TRUE(results[2].success());
+    EXPECT_EQ("a3", results[2].get_item().id());
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<m:ParentItemId Id=\"r&amp;\" ChangeKey=\"k&quot;\"/>"),
+              std::string::npos);
+}
+
+TEST_F(BatchWriteItemTest, CreateAttachmentsSendsChunks)
+{
+    set_next_fake_response_message(
+        "CreateAttachment",
+        "<m:CreateAttachmentResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Attachments>"
+        "<t:FileAttachment><t:AttachmentId Id=\"a\"/></t:FileAttachment>"
+        "</m:Attachments>"
+        "</m:CreateAttachmentResponseMessage>");
+    auto options = ews::batch_options();
+    options.chunk_size = 1U;
+    const auto results = service().create_attachments(
+        ews::item_id("r"), std::vector<ews::attachment>(2, ews::attachment()),
+        options);
+
+    ASSERT_EQ(2U, results.size());
+    EXPECT_EQ("a", results[1].get_item().id());
+    EXPECT_TRUE(service().create_attachments(ews::item_id("r"), {}).empty());
+}
+
+TEST_F(BatchWriteItemTest, MoveItemsSendsIdsAndTargetFolder)
+{
+    set_next_fake_response_for_two_writes("MoveItem");
+    auto options = ews::batch_options();
+    options.chunk_size = 2U;
+    const auto results = service().move_items(
+        make_ids(4), ews::distinguished_folder_id(ews::standard_folder::drafts),
+        options);
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(std::string::npos,
+              request.find("<m:MoveItem><m:ToFolderId>"
+                           "<t:DistinguishedFolderId Id=\"drafts\"/>"
+                           "</m:ToFolderId><m:ItemIds>"
+                           "<t:ItemId Id=\"id2\" ChangeKey=\"\"/>"
+                           "<t:ItemId Id=\"id3\" ChangeKey=\"\"/>"
+                           "</m:ItemIds></m:MoveItem>"));
+    ASSERT_EQ(4U, results.size());
+    EXPECT_EQ("new", results[2].get_item().id());
+    EXPECT_FALSE(results[3].success());
+}
+
+TEST_F(BatchWriteItemTest, CopyItemReturnsIdOfCopy)
+{
+    set_next_fake_response_message(
+        "CopyItem",
+        "<m:CopyItemResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Items>"
+        "<t:Message><t:ItemId Id=\"copy\" ChangeKey=\"ck\"/></t:Message>"
+        "</m:Items>"
+        "</m:CopyItemResponseMessage>");
+    const auto id = service().copy_item(
+        ews::item_id("orig"), ews::folder_id("target", "tck"));
+    EXPECT_EQ("copy", id.id());
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<m:CopyItem><m:ToFolderId><t:FolderId Id=\"target\""),
+              std::string::npos);
+}
+
+TEST_F(BatchWriteItemTest, MoveItemThrowsOnError)
+{
+    set_next_fake_response_message(
+        "MoveItem",
+        "<m:MoveItemResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>Nope</m:MessageText>"
+        "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "<m:Items/>"
+        "</m:MoveItemResponseMessage>");
+    EXPECT_THROW(service().move_item(ews::item_id("a"),
+                                     ews::distinguished_folder_id(
+                                         ews::standard_folder::inbox)),
+                 ews::exchange_error);
+}
+
+TEST_F(BatchWriteItemTest, ArchiveItemsNamesSourceFolder)
+{
+    set_next_fake_response_for_two_writes("ArchiveItem");
+    const auto results = service().archive_items(
+        make_ids(2), ews::distinguished_folder_id(ews::standard_folder::inbox));
+    ASSERT_EQ(2U, results.size());
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<m:ArchiveItem><m:ArchiveSourceFolderId>"
+                  "<t:DistinguishedFolderId Id=\"inbox\"/>"
+                  "</m:ArchiveSourceFolderId><m:ItemIds>"),
+              std::string::npos);
+}
+
+class PagedFindItemTest : public AsyncServiceTest
+{
+public:
+    // A <FindItemResponse> with two items and given paging attributes
+    void set_next_fake_response_for_page(const std::string& first_id,
+                                         unsigned int next_offset,
+                                         bool last_page)
+    {
+        set_next_fake_response_message(
+            "FindItem",
+            "<m:FindItemResponseMessage ResponseClass=\"Success\">"
+            "<m:ResponseCode>NoError</m:ResponseCode>"
+            "<m:RootFolder IndexedPagingOffset=\"" +
+                std::to_string(next_offset) +
+                "\" TotalItemsInView=\"5\" "
+                "IncludesLastItemInRange=\"" +
+                (last_page ? "true" : "false") +
+                "\">"
+                "<t:Items>"
+                "<t:Message><t:ItemId Id=\"" +
+                first_id +
+                "\" ChangeKey=\"ck\"/></t:Message>"
+                "<t:Message><t:ItemId Id=\"second\" ChangeKey=\"ck\"/>"
+                "</t:Message>"
+                "</t:Items>"
+                "</m:RootFolder>"
+                "</m:FindItemResponseMessage>");
+    }
+
+    ews::distinguished_folder_id inbox() const
+    {
+        return ews::distinguished_folder_id(ews::standard_folder::inbox);
+    }
+};
+
+TEST_F(PagedFindItemTest, IndexedPageItemViewToXML)
+{
+    const auto view = ews::indexed_page_item_view(10U, 20U);
+    EXPECT_EQ("<m:IndexedPageItemView MaxEntriesReturned=\"10\" "
+              "Offset=\"20\" BasePoint=\"Beginning\" />",
+              view.to_xml());
+    const auto fractional = ews::fractional_page_item_view(10U, 1U, 4U);
+    EXPECT_EQ("<m:FractionalPageItemView MaxEntriesReturned=\"10\" "
+              "Numerator=\"1\" Denominator=\"4\" />",
+              fractional.to_xml());
+}
+
+TEST_F(PagedFindItemTest, FindItemReturnsPagingInformation)
+{
+    set_next_fake_response_for_page("first", 2U, false);
+    const auto result =
+        service().find_item(ews::indexed_page_item_view(2U), inbox());
+    ASSERT_EQ(2U, result.items().size());
+    EXPECT_EQ("first", result.items().front().id());
+    EXPECT_EQ(2U, result.indexed_paging_offset());
+    EXPECT_EQ(5U, result.total_items_in_view());
+    EXPECT_FALSE(result.includes_last_item_in_range());
+
+    const auto& request = get_last_request().request_string();
+    const auto view_pos = request.find("<m:IndexedPageItemView");
+    ASSERT_NE(std::string::npos, view_pos);
+    EXPECT_LT(request.find("</m:ItemShape>"), view_pos);
+    EXPECT_LT(view_pos, request.find("<m:ParentFolderIds>"));
+}
+
+TEST_F(PagedFindItemTest, PagerRequestsNextPageFromOffset)
+{
+    set_next_fake_response_for_page("first", 2U, false);
+    auto pager = service().find_item_paged(inbox(), 2U);
+    ASSERT_TRUE(pager.has_next_page());
+    const auto page = pager.next_page();
+    ASSERT_EQ(2U, page.size());
+    EXPECT_EQ("first", page.front().id());
+    EXPECT_NE(std::string::npos,
+              get_last_request().request_string().find("Offset=\"0\""));
+
+    set_next_fake_response_for_page("third", 4U, true);
+    ASSERT_TRUE(pager.has_next_page());
+    const auto last_page = pager.next_page();
+    ASSERT_EQ(2U, last_page.size());
+    EXPECT_EQ("third", last_page.front().id());
+    EXPECT_NE(std::string::npos,
+              get_last_request().request_string().find("Offset=\"2\""));
+    EXPECT_FALSE(pager.has_next_page());
+    EXPECT_THROW(pager.next_page(), ews::exception);
+}
+
+TEST_F(PagedFindItemTest, PagerPrefetchesNextPageWithAsyncEngine)
+{
+    service().set_async_engine(engine());
+    set_next_fake_response_for_page("first", 2U, false);
+    auto pager = service().find_item_paged(inbox(), 2U);
+    set_next_fake_response_for_page("third", 4U, true);
+
+    // Returning the first page immediately requests the second one
+    const auto page = pager.next_page();
+    EXPECT_EQ("first", page.front().id());
+    EXPECT_NE(std::string::npos,
+              get_last_request().request_string().find("Offset=\"2\""));
+
+    EXPECT_EQ("third", pager.next_page().front().id());
+    EXPECT_FALSE(pager.has_next_page());
+}
+
+TEST_F(PagedFindItemTest, IteratesOverAllItems)
+{
+    set_next_fake_response_for_page("first", 2U, true);
+    auto pager = service().find_item_paged(inbox(), 2U);
+    std::vector<std::string> ids;
+    for (const auto& id : pager)
+    {
+        ids.push_back(id.id());
+    }
+    ASSERT_EQ(2U, ids.size());
+    EXPECT_EQ("first", ids[0]);
+    EXPECT_EQ("second", ids[1]);
+}
+
+TEST_F(PagedFindItemTest, PagerIncludesRestriction)
+{
+    set_next_fake_response_for_page("first", 2U, true);
+    auto pager = service().find_item_paged(
+        inbox(), ews::is_equal_to(ews::task_property_path::is_complete, false),
+        2U);
+    pager.next_page();
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(std::string::npos, request.find("<m:Restriction>"));
+    EXPECT_LT(request.find("<m:IndexedPageItemView"),
+              request.find("<m:Restriction>"));
+}
+
+TEST_F(PagedFindItemTest, PagerAcceptsPreparedRestriction)
+{
+    const auto prepared = ews::prepared_search_expression(
+        ews::is_equal_to(ews::task_property_path::is_complete,
+                         ews::search_parameter("complete")));
+    set_next_fake_response_for_page("first", 2U, true);
+    auto pager =
+        service().find_item_paged(inbox(), prepared.bind("complete", true), 2U);
+    pager.next_page();
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(std::string::npos, request.find("<m:Restriction><t:IsEqualTo>"));
+    EXPECT_NE(std::string::npos, request.find("Value=\"true\""));
+}
+
+TEST_F(PagedFindItemTest, FindMessagesReturnsShapedItems)
+{
+    set_next_fake_response_message(
+        "FindItem",
+        "<m:FindItemResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:RootFolder IndexedPagingOffset=\"2\" TotalItemsInView=\"3\" "
+        "IncludesLastItemInRange=\"false\">"
+        "<t:Items>"
+        "<t:Message><t:ItemId Id=\"first\" ChangeKey=\"ck\"/>"
+        "<t:Subject>Vogon poetry</t:Subject></t:Message>"
+        "<t:Message><t:ItemId Id=\"second\" ChangeKey=\"ck\"/>"
+        "<t:Subject>Mostly harmless</t:Subject></t:Message>"
+        "</t:Items>"
+        "</m:RootFolder>"
+        "</m:FindItemResponseMessage>");
+
+    const auto page = service().find_messages(
+        ews::indexed_page_item_view(2U), inbox(), ews::base_shape::id_only,
+        std::vector<ews::property_path>(1, ews::item_property_path::subject),
+        std::vector<ews::field_order>(
+            1, ews::field_order(ews::item_property_path::date_time_received,
+                                ews::sort_direction::descending)));
+    ASSERT_EQ(2U, page.items().size());
+    EXPECT_EQ("first", page.items()[0].get_item_id().id());
+    EXPECT_EQ("Vogon poetry", page.items()[0].get_subject());
+    EXPECT_EQ("Mostly harmless", page.items()[1].get_subject());
+    EXPECT_EQ(2U, page.paging().indexed_paging_offset());
+    EXPECT_EQ(3U, page.paging().total_items_in_view());
+    ASSERT_EQ(2U, page.paging().items().size());
+    EXPECT_EQ("second", page.paging().items()[1].id());
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(std::string::npos,
+              request.find("<t:BaseShape>IdOnly</t:BaseShape>"
+                           "<t:AdditionalProperties>"
+                           "<t:FieldURI FieldURI=\"item:Subject\"/>"
+                           "</t:AdditionalProperties>"));
+    EXPECT_NE(std::string::npos,
+              request.find("<m:SortOrder>"
+                           "<t:FieldOrder Order=\"Descending\">"
+                           "<t:FieldURI FieldURI=\"item:DateTimeReceived\"/>"
+                           "</t:FieldOrder>"
+                           "</m:SortOrder>"));
+    EXPECT_LT(request.find("<m:IndexedPageItemView"),
+              request.find("<m:SortOrder>"));
+    EXPECT_LT(request.find("<m:SortOrder>"),
+              request.find("<m:ParentFolderIds>"));
+}
+
+TEST_F(PagedFindItemTest, FindTasksSortsAfterRestriction)
+{
+    set_next_fake_response_for_page("first", 2U, true);
+    const auto page = service().find_tasks(
+        ews::indexed_page_item_view(2U), inbox(),
+        ews::is_equal_to(ews::task_property_path::is_complete, false),
+        ews::base_shape::default_shape, std::vector<ews::property_path>(),
+        std::vector<ews::field_order>(
+            1, ews::field_order(ews::item_property_path::subject)));
+    EXPECT_EQ(2U, page.items().size());
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(std::string::npos,
+              request.find("<t:BaseShape>Default</t:BaseShape>"));
+    EXPECT_NE(std::string::npos,
+              request.find("<t:FieldOrder Order=\"Ascending\">"));
+    EXPECT_LT(request.find("<m:Restriction>"), request.find("<m:SortOrder>"));
+}
+
+TEST_F(PagedFindItemTest, FindContactsAsyncReturnsShapedItems)
+{
+    service().set_async_engine(engine());
+    set_next_fake_response_for_page("first", 2U, true);
+    auto future = service().find_items_async<ews::contact>(
+        ews::indexed_page_item_view(2U), inbox(),
+        ews::is_equal_to(ews::item_property_path::subject, "Arthur"),
+        ews::base_shape::default_shape, std::vector<ews::property_path>(),
+        std::vector<ews::field_order>());
+    const auto page = future.get();
+    ASSERT_EQ(2U, page.items().size());
+    EXPECT_EQ("first", page.items()[0].get_item_id().id());
+    EXPECT_TRUE(page.paging().includes_last_item_in_range());
+}
+
+TEST_F(PagedFindItemTest, FindItemsStreamedHandsOverEachItem)
+{
+    set_next_fake_response_for_page("first", 2U, false);
+    std::vector<std::string> ids;
+    const auto paging = service().find_items_streamed<ews::message>(
+        ews::indexed_page_item_view(2U), inbox(), ews::base_shape::id_only,
+        std::vector<ews::property_path>(), std::vector<ews::field_order>(),
+        [&ids](ews::message&& msg) {
+            ids.push_back(msg.get_item_id().id());
+            return true;
+        });
+    ASSERT_EQ(2U, ids.size());
+    EXPECT_EQ("first", ids[0]);
+    EXPECT_EQ("second", ids[1]);
+    EXPECT_TRUE(paging.items().empty());
+    EXPECT_EQ(2U, paging.indexed_paging_offset());
+    EXPECT_EQ(5U, paging.total_items_in_view());
+    EXPECT_FALSE(paging.includes_last_item_in_range());
+}
+
+TEST_F(PagedFindItemTest, FindItemsStreamedStopsWhenCallbackReturnsFalse)
+{
+    set_next_fake_response_for_page("first", 2U, false);
+    auto count = 0;
+    const auto paging = service().find_items_streamed<ews::message>(
+        ews::indexed_page_item_view(2U), inbox(),
+        ews::is_equal_to(ews::item_property_path::subject, "x"),
+        ews::base_shape::id_only, std::vector<ews::property_path>(),
+        std::vector<ews::field_order>(), [&count](ews::message&&) {
+            ++count;
+            return false;
+        });
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(0U, paging.total_items_in_view());
+}
+
+TEST_F(PagedFindItemTest, GetItemsStreamedReportsFailedItemsAfterwards)
+{
+    set_next_fake_response(make_response_envelope(
+        "GetItem",
+        "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Items><t:Task><t:ItemId Id=\"abc\" ChangeKey=\"ck\"/>"
+        "<t:Subject>Write poem</t:Subject></t:Task></m:Items>"
+        "</m:GetItemResponseMessage>"
+        "<m:GetItemResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>The specified object was not found in the "
+        "store.</m:MessageText>"
+        "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "<m:Items/>"
+        "</m:GetItemResponseMessage>")
+                               .c_str());
+    std::vector<ews::item_id> ids;
+    ids.push_back(ews::item_id("abc"));
+    ids.push_back(ews::item_id("gone"));
+    std::vector<std::string> subjects;
+    EXPECT_THROW(service().get_items_streamed<ews::task>(
+                     ids, ews::base_shape::default_shape,
+                     std::vector<ews::property_path>(),
+                     [&subjects](ews::task&& t) {
+                         subjects.push_back(t.get_subject());
+                         return true;
+                     }),
+                 ews::exchange_error);
+    ASSERT_EQ(1U, subjects.size());
+    EXPECT_EQ("Write poem", subjects[0]);
+    EXPECT_NE(std::string::npos,
+              get_last_request().request_string().find("Id=\"gone\""));
+}
+
+TEST_F(PagedFindItemTest, ZeroPageSizeThrows)
+{
+    EXPECT_THROW(service().find_item_paged(inbox(), 0U), ews::exception);
+}
+
+class AsyncEngineTest : public BaseFixture
+{
+};
+
+TEST_F(AsyncEngineTest, ConnectionFailureIsReportedThroughFuture)
+{
+    ews::async_engine engine;
+    auto srv = ews::service("http://127.0.0.1:1/ews/Exchange.asmx",
+                            "FAKEDOMAIN", "fakeuser", "fakepassword");
+    srv.set_async_engine(engine);
+    auto future = srv.find_item_async(
+        ews::distinguished_folder_id(ews::standard_folder::inbox));
+    EXPECT_THROW(future.get(), ews::exception);
+    EXPECT_EQ(0U, engine.in_flight());
+}
+
+TEST_F(AsyncEngineTest, ManyRequestsInFlight)
+{
+    ews::async_engine engine;
+    auto srv = ews::service("http://127.0.0.1:1/ews/Exchange.asmx",
+                            "FAKEDOMAIN", "fakeuser", "fakepassword");
+    srv.set_async_engine(engine);
+
+    std::vector<std::future<ews::message>> futures;
+    for (int i = 0; i < 32; ++i)
+    {
+        futures.emplace_back(srv.get_message_async(ews::item_id("abc")));
+    }
+    for (auto& future : futures)
+    {
+        EXPECT_THROW(future.get(), ews::exception);
+    }
+    EXPECT_EQ(0U, engine.in_flight());
+}
+
+class ServiceTest : public ContactTest
+{
+};
+
+TEST_F(ServiceTest, UpdateItemOfReadOnlyPropertyThrows)
+{
+    auto minnie = test_contact();
+    ASSERT_FALSE(minnie.has_attachments());
+    auto prop = ews::property(ews::item_property_path::has_attachments, true);
+    EXPECT_THROW({ service().update_item(minnie.get_item_id(), prop); },
+                 ews::exchange_error);
+}
+
+TEST_F(ServiceTest, UpdateItemOfReadOnlyPropertyThrowsWhatMessage)
+{
+    auto minnie = test_contact();
+    ASSERT_FALSE(minnie.has_attachments());
+    auto prop = ews::property(ews::item_property_path::has_attachments, true);
+    try
+    {
+        service().update_item(minnie.get_item_id(), prop);
+        FAIL() << "Expected exception to be thrown";
+    }
+    catch (ews::exchange_error& exc)
+    {
+        EXPECT_STREQ("ErrorInvalidPropertySet", exc.what());
+    }
+}
+
+TEST_F(ServiceTest, UpdateItemWithSetItemField)
+{
+    // <SetItemField> is used whenever we want to replace an existing value.
+    // If none exists yet, it is created
+
+    auto minnie = test_contact();
+
+    EXPECT_STREQ("Mickey", minnie.get_spouse_name().c_str());
+    auto spouse_name_property =
+        ews::property(ews::contact_property_path::spouse_name, "Mickey");
+    auto new_id =
+        service().update_item(minnie.get_item_id(), spouse_name_property,
+                              ews::conflict_resolution::auto_resolve);
+    minnie = service().get_contact(new_id);
+    EXPECT_STREQ("Mickey", minnie.get_spouse_name().c_str());
+
+    spouse_name_property =
+        ews::property(ews::contact_property_path::spouse_name, "Peg-Leg Pedro");
+    new_id = service().update_item(minnie.get_item_id(), spouse_name_property,
+                                   ews::conflict_resolution::auto_resolve);
+    minnie = service().get_contact(new_id);
+    EXPECT_STREQ("Peg-Leg Pedro", minnie.get_spouse_name().c_str());
+}
+
+TEST_F(ServiceTest, UpdateItemWithDeleteItemField)
+{
+    // <DeleteItemField> is simply just a FieldURI to the property that we
+    // want to delete. Not much to it. It is automatically deduced by
+    // service::update_item if the user has not provided any value to the
+    // property he wanted to update
+
+    auto minnie = test_contact();
+    ASSERT_FALSE(minnie.get_given_name().empty());
+    auto prop = ews::property(ews::contact_property_path::given_name, "");
+    auto update = ews::update(prop, ews::update::operation::delete_item_field);
+    auto new_id = service().update_item(minnie.get_item_id(), update);
+    minnie = service().get_contact(new_id);
+    EXPECT_TRUE(minnie.get_given_name().empty());
+}
+
+TEST_F(ServiceTest, UpdateItemWithAppendToItemField)
+{
+    // <AppendToItemField> is automatically deduced by service::update_item
+    // so user does not need to bother. It is only valid for following
+    // properties (at least in EWS 2007 slang):
+    //
+    // - calendar:OptionalAttendees
+    // - calendar:RequiredAttendees
+    // - calendar:Resources
+    // - item:Body
+    // - message:ToRecipients
+    // - message:CcRecipients
+    // - message:BccRecipients
+    // - message:ReplyTo
+
+    auto message = ews::message();
+    message.set_subject("You are hiding again, aren't you?");
+    std::vector<ews::mailbox> recipients;
+    recipients.push_back(ews::mailbox("darkwing.duck@duckburg.com"));
+    message.set_to_recipients(recipients);
+    auto item_id =
+        service().create_item(message, ews::message_disposition::save_only);
+    on_scope_exit delete_message(
+        [&] { service().delete_message(std::move(message)); });
+    message = service().get_message(item_id);
+    recipients = message.get_to_recipients();
+    EXPECT_EQ(1U, recipients.size());
+
+    std::vector<ews::mailbox> additional_recipients;
+    additional_recipients.push_back(ews::mailbox("gus.goose@duckburg.com"));
+    auto prop = ews::property(ews::message_property_path::to_recipients,
+                              additional_recipients);
+    auto change =
+        ews::update(prop, ews::update::operation::append_to_item_field);
+    auto new_id = service().update_item(message.get_item_id(), change);
+    message = service().get_message(item_id);
+    ASSERT_EQ(2U, message.get_to_recipients().size());
+}
+
+TEST_F(ServiceTest, SendItem)
+{
+    auto msg = ews::message();
+    msg.set_subject("You are hiding again, aren't you?");
+    std::vector<ews::mailbox> recipients;
+    recipients.push_back(ews::mailbox("darkwing.duck@duckburg.com"));
+    msg.set_to_recipients(recipients);
+    const auto item_id =
+        service().create_item(msg, ews::message_disposition::save_only);
+    msg = service().get_message(item_id);
+    EXPECT_NO_THROW({ service().send_item(msg.get_item_id()); });
+}
+
+class StreamingAttachmentTest : public AsyncServiceTest
+{
+public:
+    void set_next_fake_create_attachment_response()
+    {
+        set_next_fake_response_message(
+            "CreateAttachment",
+            "<m:CreateAttachmentResponseMessage ResponseClass=\"Success\">"
+            "<m:ResponseCode>NoError</m:ResponseCode>"
+            "<m:Attachments>"
+            "<t:FileAttachment>"
+            "<t:AttachmentId Id=\"att\" RootItemId=\"abc\" "
+            "RootItemChangeKey=\"xyz\"/>"
+            "</t:FileAttachment>"
+            "</m:Attachments>"
+            "</m:CreateAttachmentResponseMessage>");
+    }
+};
+
+TEST_F(StreamingAttachmentTest, CreateAttachmentFromStream)
+{
+    set_next_fake_create_attachment_response();
+    std::istringstream content("foobar");
+    const auto id = service().create_attachment(
+        ews::item_id("abc", "def"), content, "text/plain", "a&b.txt");
+    EXPECT_EQ("att", id.id());
+    EXPECT_EQ("xyz", id.root_item_id().change_key());
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(request.find("<m:ParentItemId Id=\"abc\" ChangeKey=\"def\"/>"),
+              std::string::npos);
+    EXPECT_NE(request.find("<t:FileAttachment>"
+                           "<t:Name>a&amp;b.txt</t:Name>"
+                           "<t:ContentType>text/plain</t:ContentType>"
+                           "<t:Content>Zm9vYmFy</t:Content>"
+                           "</t:FileAttachment>"),
+              std::string::npos);
+    EXPECT_NE(request.find("</soap:Body></soap:Envelope>"), std::string::npos);
+}
+
+TEST_F(StreamingAttachmentTest, DownloadAttachmentWritesDecodedContent)
+{
+    const auto assets_dir = boost::filesystem::path(assets());
+    set_next_fake_response(
+        read_file(assets_dir / "get_attachment_response.xml"));
+    std::ostringstream os;
+    const auto a =
+        service().download_attachment(ews::attachment_id("abcde"), os);
+    EXPECT_STREQ("ballmer_peak.png", a.name().c_str());
+    EXPECT_STREQ("image/png", a.content_type().c_str());
+    EXPECT_TRUE(a.content().empty());
+
+    const auto expected = read_file(assets_dir / "ballmer_peak.png");
+    const auto actual = os.str();
+    ASSERT_EQ(expected.size(), actual.size());
+    EXPECT_TRUE(std::equal(begin(expected), end(expected), begin(actual)));
+    EXPECT_NE(get_last_request().request_string().find("<m:GetAttachment>"),
+              std::string::npos);
+}
+
+TEST_F(StreamingAttachmentTest, CreateAttachmentFromFileThrowsIfFileIsMissing)
+{
+    EXPECT_THROW(service().create_attachment_from_file(
+                     ews::item_id("abc", "def"), "does/not/exist.bin",
+                     "text/plain", "missing"),
+                 ews::exception);
+}
+
+class SyncFolderTest : public AsyncServiceTest
+{
+};
+
+TEST_F(SyncFolderTest, SyncFolderItemsReturnsChanges)
+{
+    set_next_fake_response_message(
+        "SyncFolderItems",
+        "<m:SyncFolderItemsResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:SyncState>H4sIAAA=</m:SyncState>"
+        "<m:IncludesLastItemInRange>false</m:IncludesLastItemInRange>"
+        "<m:Changes>"
+        "<t:Create><t:Message><t:ItemId Id=\"a\" ChangeKey=\"1\"/>"
+        "</t:Message></t:Create>"
+        "<t:Update><t:CalendarItem><t:ItemId Id=\"b\" ChangeKey=\"2\"/>"
+        "</t:CalendarItem></t:Update>"
+        "<t:Delete><t:ItemId Id=\"c\" ChangeKey=\"3\"/></t:Delete>"
+        "<t:ReadFlagChange><t:ItemId Id=\"d\" ChangeKey=\"4\"/>"
+        "<t:IsRead>true</t:IsRead></t:ReadFlagChange>"
+        "</m:Changes>"
+        "</m:SyncFolderItemsResponseMessage>");
+
+    const auto result = service().sync_folder_items(
+        ews::distinguished_folder_id(ews::standard_folder::inbox),
+        "previous", 100U);
+    EXPECT_EQ("H4sIAAA=", result.sync_state());
+    EXPECT_FALSE(result.includes_last_item_in_range());
+
+    const auto& changes = result.changes();
+    ASSERT_EQ(4U, changes.size());
+    EXPECT_EQ(ews::item_change::type::created, changes[0].get_type());
+    EXPECT_EQ("a", changes[0].get_item_id().id());
+    EXPECT_EQ(ews::item_change::type::updated, changes[1].get_type());
+    EXPECT_EQ("b", changes[1].get_item_id().id());
+    EXPECT_EQ(ews::item_change::type::deleted, changes[2].get_type());
+    EXPECT_EQ("c", changes[2].get_item_id().id());
+    EXPECT_EQ(ews::item_change::type::read_flag_changed, changes[3].get_type());
+    EXPECT_EQ("d", changes[3].get_item_id().id());
+    EXPECT_TRUE(changes[3].is_read());
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(request.find("<m:SyncFolderId><t:DistinguishedFolderId "
+                           "Id=\"inbox\"/></m:SyncFolderId>"),
+              std::string::npos);
+    EXPECT_NE(request.find("<m:SyncState>previous</m:SyncState>"),
+              std::string::npos);
+    EXPECT_NE(request.find("<m:MaxChangesReturned>100</m:MaxChangesReturned>"),
+              std::string::npos);
+}
+
+TEST_F(SyncFolderTest, InitialSyncOmitsSyncState)
+{
+    set_next_fake_response_message(
+        "SyncFolderItems",
+        "<m:SyncFolderItemsResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:SyncState>s1</m:SyncState>"
+        "<m:IncludesLastItemInRange>true</m:IncludesLastItemInRange>"
+        "<m:Changes/>"
+        "</m:SyncFolderItemsResponseMessage>");
+
+    const auto result = service().sync_folder_items(ews::folder_id("abc"));
+    EXPECT_EQ("s1", result.sync_state());
+    EXPECT_TRUE(result.includes_last_item_in_range());
+    EXPECT_TRUE(result.changes().empty());
+    EXPECT_EQ(get_last_request().request_string().find("SyncState"),
+              std::string::npos);
+}
+
+TEST_F(SyncFolderTest, SyncFolderItemsThrowsIfFolderIsGone)
+{
+    set_next_fake_response_message(
+        "SyncFolderItems",
+        "<m:SyncFolderItemsResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>The specified folder could not be found.</m:MessageText>"
+        "<m:ResponseCode>ErrorSyncFolderNotFound</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "</m:SyncFolderItemsResponseMessage>");
+    try
+    {
+        service().sync_folder_items(ews::folder_id("abc"), "state");
+        FAIL() << "Expected exchange_error";
+    }
+    catch (ews::exchange_error& exc)
+    {
+        EXPECT_EQ(ews::response_code::error_sync_folder_not_found, exc.code());
+    }
+}
+
+TEST_F(SyncFolderTest, SyncFolderItemsRejectsInvalidMaxChanges)
+{
+    EXPECT_THROW(service().sync_folder_items(ews::folder_id("abc"), "", 0U),
+                 ews::exception);
+    EXPECT_THROW(service().sync_folder_items(ews::folder_id("abc"), "", 513U),
+                 ews::exception);
+}
+
+TEST_F(SyncFolderTest, SyncFolderHierarchyReturnsChanges)
+{
+    set_next_fake_response_message(
+        "SyncFolderHierarchy",
+        "<m:SyncFolderHierarchyResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:SyncState>h1</m:SyncState>"
+        "<m:IncludesLastFolderInRange>true</m:IncludesLastFolderInRange>"
+        "<m:Changes>"
+        "<t:Create><t:CalendarFolder><t:FolderId Id=\"f1\" ChangeKey=\"k\"/>"
+        "</t:CalendarFolder></t:Create>"
+        "<t:Update><t:Folder><t:FolderId Id=\"f2\"/></t:Folder></t:Update>"
+        "<t:Delete><t:FolderId Id=\"f3\"/></t:Delete>"
+        "</m:Changes>"
+        "</m:SyncFolderHierarchyResponseMessage>");
+
+    const auto result = service().sync_folder_hierarchy();
+    EXPECT_EQ("h1", result.sync_state());
+    EXPECT_TRUE(result.includes_last_folder_in_range());
+    const auto& changes = result.changes();
+    ASSERT_EQ(3U, changes.size());
+    EXPECT_EQ(ews::folder_change::type::created, changes[0].get_type());
+    EXPECT_EQ("f1", changes[0].get_folder_id().id());
+    EXPECT_EQ("k", changes[0].get_folder_id().change_key());
+    EXPECT_EQ(ews::folder_change::type::updated, changes[1].get_type());
+    EXPECT_EQ("f2", changes[1].get_folder_id().id());
+    EXPECT_EQ(ews::folder_change::type::deleted, changes[2].get_type());
+    EXPECT_EQ("f3", changes[2].get_folder_id().id());
+    EXPECT_EQ(
+        get_last_request().request_string().find("<m:SyncFolderId>"),
+        std::string::npos);
+}
+
+class SubscriptionTest : public AsyncServiceTest
+{
+};
+
+TEST_F(SubscriptionTest, SubscribeCreatesPullSubscription)
+{
+    set_next_fake_response_message(
+        "Subscribe",
+        "<m:SubscribeResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:SubscriptionId>sub1</m:SubscriptionId>"
+        "<m:Watermark>w0</m:Watermark>"
+        "</m:SubscribeResponseMessage>");
+
+    const auto folders = std::vector<ews::distinguished_folder_id>{
+        ews::standard_folder::inbox, ews::standard_folder::calendar};
+    const auto events = std::vector<ews::event_type>{
+        ews::event_type::new_mail, ews::event_type::moved};
+    const auto subscription = service().subscribe(folders, events, 10U);
+    EXPECT_TRUE(subscription.valid());
+    EXPECT_EQ("sub1", subscription.id());
+    EXPECT_EQ("w0", subscription.watermark());
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(request.find("<m:PullSubscriptionRequest><t:FolderIds>"
+                           "<t:DistinguishedFolderId Id=\"inbox\"/>"
+                           "<t:DistinguishedFolderId Id=\"calendar\"/>"
+                           "</t:FolderIds><t:EventTypes>"
+                           "<t:EventType>NewMailEvent</t:EventType>"
+                           "<t:EventType>MovedEvent</t:EventType>"
+                           "</t:EventTypes><t:Timeout>10</t:Timeout>"
+                           "</m:PullSubscriptionRequest>"),
+              std::string::npos);
+}
+
+TEST_F(SubscriptionTest, SubscribeRejectsInvalidArguments)
+{
+    const auto folders = std::vector<ews::distinguished_folder_id>{
+        ews::standard_folder::inbox};
+    const auto events =
+        std::vector<ews::event_type>{ews::event_type::created};
+    EXPECT_THROW(service().subscribe(folders, events, 0U), ews::exception);
+    EXPECT_THROW(service().subscribe(folders, events, 1441U), ews::exception);
+    EXPECT_THROW(service().subscribe(
+                     folders, std::vector<ews::event_type>(), 10U),
+                 ews::exception);
+    EXPECT_THROW(
+        service().subscribe(std::vector<ews::distinguished_folder_id>(),
+                            events, 10U),
+        ews::exception);
+    EXPECT_THROW(service().subscribe_streaming(
+                     folders, std::vector<ews::event_type>{
+                                  ews::event_type::status}),
+                 ews::exception);
+}
+
+TEST_F(SubscriptionTest, GetEventsReturnsNotification)
+{
+    set_next_fake_response_message(
+        "GetEvents",
+        "<m:GetEventsResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Notification>"
+        "<t:SubscriptionId>sub1</t:SubscriptionId>"
+        "<t:PreviousWatermark>w0</t:PreviousWatermark>"
+        "<t:MoreEvents>true</t:MoreEvents>"
+        "<t:NewMailEvent>"
+        "<t:Watermark>w1</t:Watermark>"
+        "<t:TimeStamp>2026-10-14T10:00:00Z</t:TimeStamp>"
+        "<t:ItemId Id=\"m1\" ChangeKey=\"c1\"/>"
+        "<t:ParentFolderId Id=\"inbox\" ChangeKey=\"c2\"/>"
+        "</t:NewMailEvent>"
+        "<t:MovedEvent>"
+        "<t:Watermark>w2</t:Watermark>"
+        "<t:TimeStamp>2026-10-14T10:00:01Z</t:TimeStamp>"
+        "<t:FolderId Id=\"f1\"/>"
+        "<t:ParentFolderId Id=\"p2\"/>"
+        "<t:OldFolderId Id=\"f0\"/>"
+        "<t:OldParentFolderId Id=\"p1\"/>"
+        "</t:MovedEvent>"
+        "</m:Notification>"
+        "</m:GetEventsResponseMessage>");
+
+    const auto result = service().get_events("sub1", "w0");
+    EXPECT_EQ("sub1", result.subscription_id());
+    EXPECT_EQ("w0", result.previous_watermark());
+    EXPECT_TRUE(result.more_events());
+    EXPECT_EQ("w2", result.watermark());
+
+    const auto& events = result.events();
+    ASSERT_EQ(2U, events.size());
+    EXPECT_EQ(ews::event_type::new_mail, events[0].get_type());
+    EXPECT_TRUE(events[0].is_item_event());
+    EXPECT_EQ("m1", events[0].get_item_id().id());
+    EXPECT_EQ("inbox", events[0].get_parent_folder_id().id());
+    EXPECT_EQ(ews::date_time("2026-10-14T10:00:00Z"), events[0].timestamp());
+    EXPECT_EQ(ews::event_type::moved, events[1].get_type());
+    EXPECT_FALSE(events[1].is_item_event());
+    EXPECT_EQ("f1", events[1].get_folder_id().id());
+    EXPECT_EQ("f0", events[1].get_old_folder_id().id());
+    EXPECT_EQ("p1", events[1].get_old_parent_folder_id().id());
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(request.find("<m:GetEvents><m:SubscriptionId>sub1"
+                           "</m:SubscriptionId><m:Watermark>w0</m:Watermark>"
+                           "</m:GetEvents>"),
+              std::string::npos);
+}
+
+TEST_F(SubscriptionTest, GetEventsWithoutEventsKeepsWatermark)
+{
+    set_next_fake_response_message(
+        "GetEvents",
+        "<m:GetEventsResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:Notification>"
+        "<t:SubscriptionId>sub1</t:SubscriptionId>"
+        "<t:PreviousWatermark>w5</t:PreviousWatermark>"
+        "<t:MoreEvents>false</t:MoreEvents>"
+        "<t:StatusEvent><t:Watermark>w6</t:Watermark></t:StatusEvent>"
+        "</m:Notification>"
+        "</m:GetEventsResponseMessage>");
+
+    const auto result = service().get_events("sub1", "w5");
+    EXPECT_FALSE(result.more_events());
+    ASSERT_EQ(1U, result.events().size());
+    EXPECT_EQ(ews::event_type::status, result.events()[0].get_type());
+    EXPECT_EQ("w6", result.watermark());
+}
+
+TEST_F(SubscriptionTest, GetEventsThrowsIfSubscriptionIsGone)
+{
+    set_next_fake_response_message(
+        "GetEvents",
+        "<m:GetEventsResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>The specified subscription was not found."
+        "</m:MessageText>"
+        "<m:ResponseCode>ErrorSubscriptionNotFound</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "</m:GetEventsResponseMessage>");
+
+    try
+    {
+        service().get_events("sub1", "w0");
+        FAIL() << "Expected exchange_error";
+    }
+    catch (ews::exchange_error& exc)
+    {
+        EXPECT_EQ(ews::response_code::error_subscription_not_found,
+                  exc.code());
+    }
+}
+
+TEST_F(SubscriptionTest, GetStreamingEventsDispatchesEachEnvelope)
+{
+    const auto batch = [](const std::string& id) {
+        return make_response_envelope(
+            "GetStreamingEvents",
+            "<m:GetStreamingEventsResponseMessage ResponseClass=\"Success\">"
+            "<m:ResponseCode>NoError</m:ResponseCode>"
+            "<m:Notifications><m:Notification>"
+            "<t:SubscriptionId>sub1</t:SubscriptionId>"
+            "<t:CreatedEvent>"
+            "<t:TimeStamp>2026-10-14T10:00:00Z</t:TimeStamp>"
+            "<t:ItemId Id=\"" +
+                id + "\" ChangeKey=\"k\"/><t:ParentFolderId Id=\"inbox\"/>"
+                     "</t:CreatedEvent>"
+                     "</m:Notification></m:Notifications>"
+                     "</m:GetStreamingEventsResponseMessage>");
+    };
+    const auto keep_alive = make_response_envelope(
+        "GetStreamingEvents",
+        "<m:GetStreamingEventsResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "<m:ConnectionStatus>OK</m:ConnectionStatus>"
+        "</m:GetStreamingEventsResponseMessage>");
+    const auto response = batch("i1") + keep_alive + batch("i2") + batch("i3");
+    set_next_fake_response(response.c_str());
+
+    std::vector<std::string> ids;
+    service().get_streaming_events(
+        std::vector<std::string>{"sub1", "sub2"}, 5U,
+        [&](const ews::notification& n) {
+            EXPECT_EQ("sub1", n.subscription_id());
+            EXPECT_EQ(1U, n.events().size());
+            ids.push_back(n.events().front().get_item_id().id());
+            return ids.size() < 2U;
+        });
+    ASSERT_EQ(2U, ids.size());
+    EXPECT_EQ("i1", ids[0]);
+    EXPECT_EQ("i2", ids[1]);
+
+    const auto& request = get_last_request().request_string();
+    EXPECT_NE(request.find("<m:SubscriptionIds>"
+                           "<t:SubscriptionId>sub1</t:SubscriptionId>"
+                           "<t:SubscriptionId>sub2</t:SubscriptionId>"
+                           "</m:SubscriptionIds>"
+                           "<m:ConnectionTimeout>5</m:ConnectionTimeout>"),
+              std::string::npos);
+}
+
+TEST_F(SubscriptionTest, GetStreamingEventsThrowsOnErrorMessage)
+{
+    set_next_fake_response_message(
+        "GetStreamingEvents",
+        "<m:GetStreamingEventsResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>The specified subscription was not found."
+        "</m:MessageText>"
+        "<m:ResponseCode>ErrorSubscriptionNotFound</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "</m:GetStreamingEventsResponseMessage>");
+
+    EXPECT_THROW(service().get_streaming_events(
+                     std::vector<std::string>{"sub1"}, 5U,
+                     [](const ews::notification&) { return true; }),
+                 ews::exchange_error);
+    EXPECT_THROW(service().get_streaming_events(
+                     std::vector<std::string>{"sub1"}, 31U,
+                     [](const ews::notification&) { return true; }),
+                 ews::exception);
+}
+
+TEST_F(SubscriptionTest, UnsubscribeSendsSubscriptionId)
+{
+    set_next_fake_response_message(
+        "Unsubscribe",
+        "<m:UnsubscribeResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "</m:UnsubscribeResponseMessage>");
+
+    service().unsubscribe("sub1");
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<m:Unsubscribe><m:SubscriptionId>sub1</m:SubscriptionId>"
+                  "</m:Unsubscribe>"),
+              std::string::npos);
+}
+
+class ItemCacheTest : public AsyncServiceTest
+{
+public:
+    void set_next_fake_message(const std::string& id,
+                               const std::string& change_key,
+                               const std::string& subject)
+    {
+        set_next_fake_response_message(
+            "GetItem", "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+                       "<m:ResponseCode>NoError</m:ResponseCode>"
+                       "<m:Items>"
+                       "<t:Message>"
+                       "<t:ItemId Id=\"" +
+                           id + "\" ChangeKey=\"" + change_key +
+                           "\"/>"
+                           "<t:Subject>" +
+                           subject + "</t:Subject>"
+                                     "</t:Message>"
+                                     "</m:Items>"
+                                     "</m:GetItemResponseMessage>");
+    }
+};
+
+TEST_F(ItemCacheTest, DisabledByDefault)
+{
+    set_next_fake_message("abc", "1", "first");
+    EXPECT_EQ("first",
+              service().get_message(ews::item_id("abc")).get_subject());
+    set_next_fake_message("abc", "1", "second");
+    EXPECT_EQ("second",
+              service().get_message(ews::item_id("abc")).get_subject());
+
+    const auto stats = service().get_item_cache_statistics();
+    EXPECT_EQ(0U, stats.hits);
+    EXPECT_EQ(0U, stats.misses);
+    EXPECT_EQ(0U, stats.size);
+}
+
+TEST_F(ItemCacheTest, RepeatedGetReturnsCachedItem)
+{
+    service().enable_item_cache(8U, std::chrono::minutes(1));
+    set_next_fake_message("abc", "1", "first");
+    EXPECT_EQ("first",
+              service().get_message(ews::item_id("abc")).get_subject());
+
+    // Would be returned if the item were fetched again
+    set_next_fake_message("abc", "1", "second");
+    EXPECT_EQ("first",
+              service().get_message(ews::item_id("abc")).get_subject());
+    EXPECT_EQ("first",
+              service().get_message(ews::item_id("abc", "1")).get_subject());
+
+    auto stats = service().get_item_cache_statistics();
+    EXPECT_EQ(2U, stats.hits);
+    EXPECT_EQ(1U, stats.misses);
+    EXPECT_EQ(1U, stats.size);
+
+    // Different shape, different entry
+    const auto props = std::vector<ews::property_path>{
+        ews::item_property_path::subject};
+    EXPECT_EQ("second", service()
+                            .get_message(ews::item_id("abc"), props)
+                            .get_subject());
+    stats = service().get_item_cache_statistics();
+    EXPECT_EQ(2U, stats.misses);
+    EXPECT_EQ(2U, stats.size);
+
+    service().clear_item_cache();
+    EXPECT_EQ(0U, service().get_item_cache_statistics().size);
+}
+
+TEST_F(ItemCacheTest, SwitchingMailboxClearsCache)
+{
+    service().enable_item_cache(8U, std::chrono::minutes(1));
+    service().impersonate(ews::connecting_sid(
+        ews::connecting_sid::type::smtp_address, "gus@duckburg.com"));
+    set_next_fake_message("abc", "1", "gus");
+    EXPECT_EQ("gus", service().get_message(ews::item_id("abc")).get_subject());
+
+    // Same account again: still cached
+    service().impersonate(ews::connecting_sid(
+        ews::connecting_sid::type::smtp_address, "gus@duckburg.com"));
+    set_next_fake_message("abc", "1", "daisy");
+    EXPECT_EQ("gus", service().get_message(ews::item_id("abc")).get_subject());
+
+    // Another account must go to the server
+    service().impersonate(ews::connecting_sid(
+        ews::connecting_sid::type::smtp_address, "daisy@duckburg.com"));
+    EXPECT_EQ(0U, service().get_item_cache_statistics().size);
+    EXPECT_EQ("daisy",
+              service().get_message(ews::item_id("abc")).get_subject());
+    EXPECT_TRUE(get_last_request().header_contains("daisy@duckburg.com"));
+
+    set_next_fake_message("abc", "1", "own");
+    service().stop_impersonating();
+    EXPECT_EQ("own", service().get_message(ews::item_id("abc")).get_subject());
+}
+
+TEST_F(ItemCacheTest, NewChangeKeyFetchesItemAgain)
+{
+    service().enable_item_cache(8U, std::chrono::minutes(1));
+    set_next_fake_message("abc", "1", "first");
+    service().get_message(ews::item_id("abc", "1"));
+
+    set_next_fake_message("abc", "2", "second");
+    const auto msg = service().get_message(ews::item_id("abc", "2"));
+    EXPECT_EQ("second", msg.get_subject());
+    EXPECT_EQ("2", msg.get_item_id().change_key());
+    EXPECT_EQ("second",
+              service().get_message(ews::item_id("abc", "2")).get_subject());
+
+    const auto stats = service().get_item_cache_statistics();
+    EXPECT_EQ(1U, stats.hits);
+    EXPECT_EQ(2U, stats.misses);
+    EXPECT_EQ(1U, stats.size);
+}
+
+TEST_F(ItemCacheTest, ExpiredItemIsFetchedAgain)
+{
+    service().enable_item_cache(8U, std::chrono::milliseconds(0));
+    set_next_fake_message("abc", "1", "first");
+    service().get_message(ews::item_id("abc"));
+    set_next_fake_message("abc", "1", "second");
+    EXPECT_EQ("second",
+              service().get_message(ews::item_id("abc")).get_subject());
+    EXPECT_EQ(0U, service().get_item_cache_statistics().hits);
+}
+
+TEST_F(ItemCacheTest, LeastRecentlyUsedItemIsEvicted)
+{
+    service().enable_item_cache(2U, std::chrono::minutes(1));
+    set_next_fake_message("a", "1", "a");
+    service().get_message(ews::item_id("a"));
+    set_next_fake_message("b", "1", "b");
+    service().get_message(ews::item_id("b"));
+    service().get_message(ews::item_id("a")); // Hit; b is older now
+    set_next_fake_message("c", "1", "c");
+    service().get_message(ews::item_id("c"));
+
+    auto stats = service().get_item_cache_statistics();
+    EXPECT_EQ(1U, stats.evictions);
+    EXPECT_EQ(2U, stats.size);
+
+    set_next_fake_message("b", "1", "b again");
+    EXPECT_EQ("a", service().get_message(ews::item_id("a")).get_subject());
+    EXPECT_EQ("b again",
+              service().get_message(ews::item_id("b")).get_subject());
+}
+
+TEST_F(ItemCacheTest, DeletedItemIsDropped)
+{
+    service().enable_item_cache(8U, std::chrono::minutes(1));
+    set_next_fake_message("abc", "1", "first");
+    service().get_message(ews::item_id("abc"));
+
+    set_next_fake_response_message(
+        "DeleteItem", "<m:DeleteItemResponseMessage ResponseClass=\"Success\">"
+                      "<m:ResponseCode>NoError</m:ResponseCode>"
+                      "</m:DeleteItemResponseMessage>");
+    service().delete_item(ews::item_id("abc", "1"));
+    EXPECT_EQ(0U, service().get_item_cache_statistics().size);
+}
+
+TEST_F(ItemCacheTest, OtherItemTypeIsNotReturned)
+{
+    service().enable_item_cache(8U, std::chrono::minutes(1));
+    set_next_fake_message("abc", "1", "first");
+    service().get_message(ews::item_id("abc"));
+
+    set_next_fake_response_message(
+        "GetItem", "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+                   "<m:ResponseCode>NoError</m:ResponseCode>"
+                   "<m:Items>"
+                   "<t:Task>"
+                   "<t:ItemId Id=\"abc\" ChangeKey=\"1\"/>"
+                   "<t:Subject>Clean the windows</t:Subject>"
+                   "</t:Task>"
+                   "</m:Items>"
+                   "</m:GetItemResponseMessage>");
+    EXPECT_EQ("Clean the windows",
+              service().get_task(ews::item_id("abc")).get_subject());
+    EXPECT_EQ(0U, service().get_item_cache_statistics().hits);
+}
+
+class RequestObserverTest : public AsyncServiceTest
+{
+public:
+    struct recorder : public ews::request_observer
+    {
+        void on_request_completed(const ews::request_metrics& m) override
+        {
+            metrics.push_back(m);
+        }
+
+        std::vector<ews::request_metrics> metrics;
+    };
+
+    void set_next_fake_get_item_response(std::size_t count)
+    {
+        std::string messages;
+        for (std::size_t i = 0U; i < count; ++i)
+        {
+            messages += "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+                        "<m:ResponseCode>NoError</m:ResponseCode>"
+                        "<m:Items><t:CalendarItem>"
+                        "<t:ItemId Id=\"id" +
+                        std::to_string(i) +
+                        "\" ChangeKey=\"ck\"/>"
+                        "<t:Subject>Hi</t:Subject>"
+                        "</t:CalendarItem></m:Items>"
+                        "</m:GetItemResponseMessage>";
+        }
+        set_next_fake_response_message("GetItem", messages);
+    }
+};
+
+TEST_F(RequestObserverTest, ReportsEachRequest)
+{
+    recorder rec;
+    service().set_request_observer(&rec);
+    set_next_fake_get_item_response(1U);
+    service().get_calendar_item(ews::item_id("id0"));
+
+    ASSERT_EQ(1U, rec.metrics.size());
+    const auto& m = rec.metrics.front();
+    EXPECT_EQ("GetItem", m.operation);
+    EXPECT_EQ(get_last_request().request_string().size(), m.request_bytes);
+    EXPECT_EQ(make_response_envelope("GetItem", "").size() +
+                  std::strlen("<m:GetItemResponseMessage "
+                              "ResponseClass=\"Success\">"
+                              "<m:ResponseCode>NoError</m:ResponseCode>"
+                              "<m:Items><t:CalendarItem>"
+                              "<t:ItemId Id=\"id0\" ChangeKey=\"ck\"/>"
+                              "<t:Subject>Hi</t:Subject>"
+                              "</t:CalendarItem></m:Items>"
+                              "</m:GetItemResponseMessage>"),
+              m.response_bytes);
+    EXPECT_EQ(200L, m.http_status);
+    EXPECT_EQ(1U, m.result_count);
+
+    // Not sent through libcurl
+    EXPECT_EQ(0, m.total_time.count());
+}
+
+TEST_F(RequestObserverTest, CountsResponseMessagesOfBatches)
+{
+    recorder rec;
+    service().set_request_observer(&rec);
+    set_next_fake_get_item_response(3U);
+    const auto ids = std::vector<ews::item_id>{
+        ews::item_id("id0"), ews::item_id("id1"), ews::item_id("id2")};
+    service().get_calendar_items(ids, ews::base_shape::all_properties);
+
+    ASSERT_EQ(1U, rec.metrics.size());
+    EXPECT_EQ("GetItem", rec.metrics.front().operation);
+    EXPECT_EQ(3U, rec.metrics.front().result_count);
+}
+
+TEST_F(RequestObserverTest, ReportsFailedOperations)
+{
+    recorder rec;
+    service().set_request_observer(&rec);
+    set_next_fake_response_message(
+        "DeleteItem",
+        "<m:DeleteItemResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>The specified object was not found in the "
+        "store.</m:MessageText>"
+        "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "</m:DeleteItemResponseMessage>");
+    EXPECT_THROW(service().delete_item(ews::item_id("abc")),
+                 ews::exchange_error);
+
+    ASSERT_EQ(1U, rec.metrics.size());
+    EXPECT_EQ("DeleteItem", rec.metrics.front().operation);
+    EXPECT_EQ(1U, rec.metrics.front().result_count);
+}
+
+TEST_F(RequestObserverTest, ReportsAsyncRequests)
+{
+    recorder rec;
+    service().set_async_engine(engine());
+    service().set_request_observer(&rec);
+    set_next_fake_get_item_response(1U);
+    service().get_calendar_item_async(ews::item_id("id0")).get();
+
+    ASSERT_EQ(1U, rec.metrics.size());
+    EXPECT_EQ("GetItem", rec.metrics.front().operation);
+    EXPECT_EQ(1U, rec.metrics.front().result_count);
+}
+
+TEST_F(RequestObserverTest, StopsReportingWhenObserverIsRemoved)
+{
+    set_next_fake_response_message(
+        "Unsubscribe",
+        "<m:UnsubscribeResponseMessage ResponseClass=\"Success\">"
+        "<m:ResponseCode>NoError</m:ResponseCode>"
+        "</m:UnsubscribeResponseMessage>");
+    recorder rec;
+    service().set_request_observer(&rec);
+    service().unsubscribe("sub1");
+    service().set_request_observer(nullptr);
+    service().unsubscribe("sub1");
+    ASSERT_EQ(1U, rec.metrics.size());
+    EXPECT_EQ("Unsubscribe", rec.metrics.front().operation);
+}
+
+class RetryTest : public AsyncServiceTest
+{
+public:
+    void SetUp()
+    {
+        AsyncServiceTest::SetUp();
+        set_next_fake_response_message(
+            "GetItem", "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+                       "<m:ResponseCode>NoError</m:ResponseCode>"
+                       "<m:Items><t:CalendarItem>"
+                       "<t:ItemId Id=\"abc\" ChangeKey=\"ck\"/>"
+                       "<t:Subject>Retried</t:Subject>"
+                       "</t:CalendarItem></m:Items>"
+                       "</m:GetItemResponseMessage>");
+    }
+
+    static std::string server_busy_fault(int back_off_ms)
+    {
+        return "<s:Envelope "
+               "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+               "<s:Body><s:Fault>"
+               "<faultcode xmlns:a=\"http://schemas.microsoft.com/exchange/"
+               "services/2006/types\">a:ErrorServerBusy</faultcode>"
+               "<faultstring xml:lang=\"en-US\">The server cannot service "
+               "this request right now. Try again later.</faultstring>"
+               "<detail>"
+               "<e:ResponseCode xmlns:e=\"http://schemas.microsoft.com/"
+               "exchange/services/2006/errors\">ErrorServerBusy"
+               "</e:ResponseCode>"
+               "<t:MessageXml xmlns:t=\"http://schemas.microsoft.com/"
+               "exchange/services/2006/types\">"
+               "<t:Value Name=\"BackOffMilliseconds\">" +
+               std::to_string(back_off_ms) +
+               "</t:Value>"
+               "</t:MessageXml>"
+               "</detail>"
+               "</s:Fault></s:Body></s:Envelope>";
+    }
+
+    static ews::retry_policy fast_retries(std::size_t max_retries)
+    {
+        ews::retry_policy policy;
+        policy.max_retries = max_retries;
+        policy.initial_backoff = std::chrono::milliseconds(1);
+        policy.max_backoff = std::chrono::milliseconds(4);
+        return policy;
+    }
+};
+
+TEST_F(RetryTest, ServerBusyErrorCarriesBackOffHint)
+{
+    queue_fake_response(500, server_busy_fault(1234));
+    try
+    {
+        service().get_calendar_item(ews::item_id("abc"));
+        FAIL() << "Expected server_busy_error";
+    }
+    catch (ews::server_busy_error& exc)
+    {
+        EXPECT_EQ(1234, exc.back_off().count());
+        EXPECT_STREQ("The server cannot service this request right now. Try "
+                     "again later.",
+                     exc.what());
+    }
+}
+
+TEST_F(RetryTest, RetriesAfterServerBackOff)
+{
+    service().set_retry_policy(fast_retries(2U));
+    queue_fake_response(500, server_busy_fault(20));
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto item = service().get_calendar_item(ews::item_id("abc"));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ("Retried", item.get_subject());
+    EXPECT_EQ(0U, queued_fake_responses());
+    EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+}
+
+TEST_F(RetryTest, RetriesServiceUnavailable)
+{
+    service().set_retry_policy(fast_retries(1U));
+    queue_fake_response(503, "<html>Service Unavailable</html>");
+    EXPECT_EQ("Retried", service()
+                             .get_calendar_item(ews::item_id("abc"))
+                             .get_subject());
+}
+
+TEST_F(RetryTest, GivesUpAfterMaxRetries)
+{
+    service().set_retry_policy(fast_retries(2U));
+    for (int i = 0; i < 4; ++i)
+    {
+        queue_fake_response(500, server_busy_fault(0));
+    }
+    EXPECT_THROW(service().get_calendar_item(ews::item_id("abc")),
+                 ews::server_busy_error);
+
+    // The original attempt plus two retries
+    EXPECT_EQ(1U, queued_fake_responses());
+}
+
+TEST_F(RetryTest, DoesNotRetryWritesByDefault)
+{
+    service().set_retry_policy(fast_retries(2U));
+    queue_fake_response(500, server_busy_fault(0));
+    EXPECT_THROW(service().delete_item(ews::item_id("abc")),
+                 ews::server_busy_error);
+    EXPECT_EQ(0U, queued_fake_responses());
+
+    auto policy = fast_retries(2U);
+    policy.retry_all_operations = true;
+    service().set_retry_policy(policy);
+    queue_fake_response(500, server_busy_fault(0));
+    set_next_fake_response_message(
+        "DeleteItem", "<m:DeleteItemResponseMessage ResponseClass=\"Success\">"
+                      "<m:ResponseCode>NoError</m:ResponseCode>"
+                      "</m:DeleteItemResponseMessage>");
+    service().delete_item(ews::item_id("abc"));
+    EXPECT_EQ(0U, queued_fake_responses());
+}
+
+TEST_F(RetryTest, DoesNotRetryOtherErrors)
+{
+    service().set_retry_policy(fast_retries(2U));
+    queue_fake_response(404, "Not Found");
+    EXPECT_THROW(service().get_calendar_item(ews::item_id("abc")),
+                 ews::http_error);
+}
+
+TEST_F(RetryTest, RetriesAsyncBatchChunks)
+{
+    service().set_async_engine(engine());
+    service().set_retry_policy(fast_retries(1U));
+    queue_fake_response(500, server_busy_fault(0));
+
+    ews::batch_options options;
+    options.max_parallel_requests = 2U;
+    const auto items = service().get_items<ews::calendar_item>(
+        std::vector<ews::item_id>{ews::item_id("abc")},
+        ews::base_shape::all_properties, options);
+    ASSERT_EQ(1U, items.size());
+    EXPECT_TRUE(items[0].success());
+    EXPECT_EQ("Retried", items[0].get_item().get_subject());
+}
+
+TEST_F(RetryTest, RetriesBusyItemsOfBatch)
+{
+    const auto busy = std::string(
+        "<m:GetItemResponseMessage ResponseClass=\"Error\">"
+        "<m:MessageText>The server cannot service this request right now. "
+        "Try again later.</m:MessageText>"
+        "<m:ResponseCode>ErrorServerBusy</m:ResponseCode>"
+        "<m:DescriptiveLinkKey>0</m:DescriptiveLinkKey>"
+        "<m:Items/>"
+        "</m:GetItemResponseMessage>");
+    const auto found = [](const std::string& subject) {
+        return "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+               "<m:ResponseCode>NoError</m:ResponseCode>"
+               "<m:Items><t:CalendarItem>"
+               "<t:ItemId Id=\"abc\" ChangeKey=\"ck\"/>"
+               "<t:Subject>" +
+               subject + "</t:Subject>"
+                         "</t:CalendarItem></m:Items>"
+                         "</m:GetItemResponseMessage>";
+    };
+    const auto ids = std::vector<ews::item_id>{
+        ews::item_id("i0"), ews::item_id("i1"), ews::item_id("i2"),
+        ews::item_id("i3")};
+
+    // Without retries, busy items are returned as failed
+    queue_fake_response(
+        200, make_response_envelope("GetItem", found("First") + busy +
+                                                   found("Third") + busy));
+    auto items = service().get_items<ews::calendar_item>(
+        ids, ews::base_shape::all_properties);
+    ASSERT_EQ(4U, items.size());
+    EXPECT_EQ(ews::response_code::error_server_busy,
+              items[1].get_response_code());
+
+    // Only the range from the first to the last busy item is sent again
+    service().set_retry_policy(fast_retries(1U));
+    queue_fake_response(
+        200, make_response_envelope("GetItem", found("First") + busy +
+                                                   found("Third") + busy));
+    set_next_fake_response_message(
+        "GetItem", found("Second") + found("Third") + found("Fourth"));
+    items = service().get_items<ews::calendar_item>(
+        ids, ews::base_shape::all_properties);
+    EXPECT_EQ(0U, queued_fake_responses());
+    const auto& request = get_last_request().request_string();
+    EXPECT_EQ(std::string::npos, request.find("Id=\"i0\""));
+    EXPECT_NE(std::string::npos, request.find("Id=\"i1\""));
+    EXPECT_NE(std::string::npos, request.find("Id=\"i3\""));
+    ASSERT_EQ(4U, items.size());
+    for (const auto& item : items)
+    {
+        EXPECT_TRUE(item.success());
+    }
+    EXPECT_EQ("First", items[0].get_item().get_subject());
+    EXPECT_EQ("Second", items[1].get_item().get_subject());
+    EXPECT_EQ("Fourth", items[3].get_item().get_subject());
+}
+
+TEST(RequestLimiterTest, RejectsZeroLimit)
+{
+    EXPECT_THROW(ews::request_limiter(0U), ews::exception);
+}
+
+TEST(RequestLimiterTest, LimitsConcurrentRequests)
+{
+    ews::request_limiter limiter(2U);
+    EXPECT_EQ(2U, limiter.max_concurrent_requests());
+
+    std::atomic<int> running(0);
+    std::atomic<int> max_running(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 6; ++i)
+    {
+        threads.emplace_back([&] {
+            for (int j = 0; j < 5; ++j)
+            {
+                limiter.acquire();
+                const auto now = ++running;
+                auto prev = max_running.load();
+                while (now > prev &&
+                       !max_running.compare_exchange_weak(prev, now))
+                {
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                --running;
+                limiter.release();
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    EXPECT_LE(max_running.load(), 2);
+    EXPECT_EQ(0U, limiter.in_use());
+}
+
+TEST_F(RetryTest, ServiceReleasesLimiterSlots)
+{
+    ews::request_limiter limiter(1U);
+    service().set_request_limiter(&limiter);
+    service().set_async_engine(engine());
+    service().get_calendar_item(ews::item_id("abc"));
+    service().get_calendar_item_async(ews::item_id("abc")).get();
+    queue_fake_response(500, server_busy_fault(0));
+    EXPECT_THROW(service().get_calendar_item(ews::item_id("abc")),
+                 ews::server_busy_error);
+    EXPECT_EQ(0U, limiter.in_use());
+}
+
+class TransportOptionsTest : public FakeServiceFixture
+{
+};
+
+TEST_F(TransportOptionsTest, EverythingIsOffByDefault)
+{
+    const auto& options = service().get_transport_options();
+    EXPECT_FALSE(options.accept_compressed_responses);
+    EXPECT_FALSE(options.compress_requests);
+    EXPECT_EQ(ews::http_version::automatic, options.version);
+}
+
+TEST_F(TransportOptionsTest, OptionsAreAppliedToRequestHandler)
+{
+    ews::transport_options options;
+    options.accept_compressed_responses = true;
+    options.compress_requests = true;
+    options.min_compressed_request_size = 42U;
+    options.version = ews::http_version::http_2;
+    service().set_transport_options(options);
+
+    const auto& applied = http_request_mock::storage::instance().transport;
+    EXPECT_TRUE(applied.accept_compressed_responses);
+    EXPECT_TRUE(applied.compress_requests);
+    EXPECT_EQ(42U, applied.min_compressed_request_size);
+    EXPECT_EQ(ews::http_version::http_2, applied.version);
+
+    EXPECT_TRUE(service().get_transport_options().compress_requests);
+    EXPECT_EQ(ews::http_version::http_2,
+              service().get_transport_options().version);
+}
+
+class MailboxExportTest : public AsyncServiceTest
+{
+public:
+    struct recording_sink final : public ews::export_sink
+    {
+        void write_item(const ews::folder_id& folder,
+                        const ews::item& the_item) override
+        {
+            const auto mime = the_item.get_mime_content();
+            items.push_back(folder.id() + "/" + the_item.get_item_id().id() +
+                            ":" + std::string(mime.bytes(), mime.len_bytes()));
+        }
+
+        std::ostream* open_attachment(const ews::item&,
+                                      const ews::attachment& a) override
+        {
+            attachment_names.push_back(a.name());
+            return &attachment_content;
+        }
+
+        void on_item_error(const ews::folder_id&, const ews::item_id& id,
+                           ews::response_code) override
+        {
+            failed.push_back(id.id());
+        }
+
+        void on_attachment_error(const ews::item&, const ews::attachment& a,
+                                 const ews::exchange_error&) override
+        {
+            failed_attachments.push_back(a.name());
+        }
+
+        bool on_folder_error(const ews::folder_id& folder,
+                             const ews::exchange_error&) override
+        {
+            failed_folders.push_back(folder.id());
+            return skip_failed_folders;
+        }
+
+        void checkpoint(const ews::export_checkpoint& cp) override
+        {
+            checkpoints.push_back(cp.to_string());
+        }
+
+        bool skip_failed_folders = false;
+        std::vector<std::string> items;
+        std::vector<std::string> failed;
+        std::vector<std::string> failed_attachments;
+        std::vector<std::string> failed_folders;
+        std::vector<std::string> attachment_names;
+        std::vector<std::string> checkpoints;
+        std::ostringstream attachment_content;
+    };
+
+    void queue_hierarchy()
+    {
+        queue_fake_response(
+            200,
+            make_response_envelope(
+                "SyncFolderHierarchy",
+                "<m:SyncFolderHierarchyResponseMessage "
+                "ResponseClass=\"Success\">"
+                "<m:ResponseCode>NoError</m:ResponseCode>"
+                "<m:SyncState>h1</m:SyncState>"
+                "<m:IncludesLastFolderInRange>true"
+                "</m:IncludesLastFolderInRange>"
+                "<m:Changes>"
+                "<t:Create><t:Folder><t:FolderId Id=\"f1\"/></t:Folder>"
+                "</t:Create>"
+                "<t:Delete><t:FolderId Id=\"f2\"/></t:Delete>"
+                "</m:Changes>"
+                "</m:SyncFolderHierarchyResponseMessage>"));
+    }
+
+    void queue_find_item(const std::string& items)
+    {
+        queue_fake_response(
+            200, make_response_envelope(
+                     "FindItem",
+                     "<m:FindItemResponseMessage ResponseClass=\"Success\">"
+                     "<m:ResponseCode>NoError</m:ResponseCode>"
+                     "<m:RootFolder IndexedPagingOffset=\"2\" "
+                     "TotalItemsInView=\"2\" IncludesLastItemInRange=\"true\">"
+                     "<t:Items>" +
+                         items +
+                         "</t:Items>"
+                         "</m:RootFolder>"
+                         "</m:FindItemResponseMessage>"));
+    }
+
+    static ews::distinguished_folder_id inbox()
+    {
+        return ews::distinguished_folder_id(ews::standard_folder::inbox);
+    }
+};
+
+TEST_F(MailboxExportTest, ListsFoldersBelowRoot)
+{
+    queue_hierarchy();
+    ews::basic_mailbox_exporter<http_request_mock> exporter(service());
+    const auto folders = exporter.list_folders(inbox());
+    ASSERT_EQ(2U, folders.size());
+    EXPECT_EQ("inbox", folders[0].id());
+    EXPECT_EQ("f1", folders[1].id());
+
+    ews::export_options options;
+    options.include_subfolders = false;
+    ews::basic_mailbox_exporter<http_request_mock> shallow(service(), options);
+    EXPECT_EQ(1U, shallow.list_folders(inbox()).size());
+}
+
+TEST_F(MailboxExportTest, WritesItemsAndAttachments)
+{
+    queue_hierarchy();
+    queue_find_item(
+        "<t:Message><t:ItemId Id=\"i1\" ChangeKey=\"ck\"/></t:Message>"
+        "<t:Message><t:ItemId Id=\"i2\" ChangeKey=\"ck\"/></t:Message>");
+    queue_fake_response(
+        200,
+        make_response_envelope(
+            "GetItem",
+            "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+            "<m:ResponseCode>NoError</m:ResponseCode>"
+            "<m:Items><t:Message><t:ItemId Id=\"i1\" ChangeKey=\"ck\"/>"
+            "<t:MimeContent CharacterSet=\"UTF-8\">SGVsbG8=</t:MimeContent>"
+            "<t:Attachments><t:FileAttachment>"
+            "<t:AttachmentId Id=\"att1\"/><t:Name>a.png</t:Name>"
+            "</t:FileAttachment></t:Attachments>"
+            "<t:HasAttachments>true</t:HasAttachments>"
+            "</t:Message></m:Items>"
+            "</m:GetItemResponseMessage>"
+            "<m:GetItemResponseMessage ResponseClass=\"Error\">"
+            "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+            "<m:Items/>"
+            "</m:GetItemResponseMessage>"));
+    queue_find_item("");
+    set_next_fake_response(
+        read_file(boost::filesystem::path(assets()) /
+                  "get_attachment_response.xml"));
+
+    recording_sink sink;
+    ews::basic_mailbox_exporter<http_request_mock> exporter(service());
+    const auto stats = exporter.run(inbox(), sink);
+
+    ASSERT_EQ(1U, sink.items.size());
+    EXPECT_EQ("inbox/i1:SGVsbG8=", sink.items[0]);
+    ASSERT_EQ(1U, sink.failed.size());
+    EXPECT_EQ("i2", sink.failed[0]);
+    ASSERT_EQ(1U, sink.attachment_names.size());
+    EXPECT_EQ("a.png", sink.attachment_names[0]);
+    EXPECT_FALSE(sink.attachment_content.str().empty());
+
+    EXPECT_EQ(2U, stats.folders);
+    EXPECT_EQ(1U, stats.items);
+    EXPECT_EQ(1U, stats.failed_items);
+    EXPECT_EQ(1U, stats.attachments);
+    EXPECT_EQ(sink.attachment_content.str().size(), stats.attachment_bytes);
+    EXPECT_EQ(0U, queued_fake_responses());
+
+    ASSERT_EQ(3U, sink.checkpoints.size());
+    EXPECT_EQ("at 2 inbox\n", sink.checkpoints[0]);
+    EXPECT_EQ("done inbox\n", sink.checkpoints[1]);
+    EXPECT_EQ("done inbox\ndone f1\n", sink.checkpoints[2]);
+}
+
+TEST_F(MailboxExportTest, FailedAttachmentDoesNotSkipFolder)
+{
+    queue_hierarchy();
+    queue_find_item(
+        "<t:Message><t:ItemId Id=\"i1\" ChangeKey=\"ck\"/></t:Message>"
+        "<t:Message><t:ItemId Id=\"i2\" ChangeKey=\"ck\"/></t:Message>");
+    queue_fake_response(
+        200,
+        make_response_envelope(
+            "GetItem",
+            "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+            "<m:ResponseCode>NoError</m:ResponseCode>"
+            "<m:Items><t:Message><t:ItemId Id=\"i1\" ChangeKey=\"ck\"/>"
+            "<t:MimeContent CharacterSet=\"UTF-8\">SGVsbG8=</t:MimeContent>"
+            "<t:Attachments><t:FileAttachment>"
+            "<t:AttachmentId Id=\"att1\"/><t:Name>a.png</t:Name>"
+            "</t:FileAttachment></t:Attachments>"
+            "<t:HasAttachments>true</t:HasAttachments>"
+            "</t:Message></m:Items>"
+            "</m:GetItemResponseMessage>"
+            "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+            "<m:ResponseCode>NoError</m:ResponseCode>"
+            "<m:Items><t:Message><t:ItemId Id=\"i2\" ChangeKey=\"ck\"/>"
+            "<t:MimeContent CharacterSet=\"UTF-8\">SGk=</t:MimeContent>"
+            "</t:Message></m:Items>"
+            "</m:GetItemResponseMessage>"));
+    queue_find_item("");
+    set_next_fake_response_message(
+        "GetAttachment",
+        "<m:GetAttachmentResponseMessage ResponseClass=\"Error\">"
+        "<m:ResponseCode>ErrorItemNotFound</m:ResponseCode>"
+        "<m:Attachments/>"
+        "</m:GetAttachmentResponseMessage>");
+
+    recording_sink sink;
+    ews::basic_mailbox_exporter<http_request_mock> exporter(service());
+    const auto stats = exporter.run(inbox(), sink);
+
+    ASSERT_EQ(2U, sink.items.size());
+    EXPECT_EQ("inbox/i2:SGk=", sink.items[1]);
+    ASSERT_EQ(1U, sink.failed_attachments.size());
+    EXPECT_EQ("a.png", sink.failed_attachments[0]);
+    EXPECT_TRUE(sink.failed_folders.empty());
+    EXPECT_EQ(2U, stats.folders);
+    EXPECT_EQ(0U, stats.attachments);
+    EXPECT_EQ(1U, stats.failed_attachments);
+}
+
+TEST_F(MailboxExportTest, FailedListingIsReportedPerFolder)
+{
+    queue_hierarchy();
+    queue_fake_response(
+        200, make_response_envelope(
+                 "FindItem",
+                 "<m:FindItemResponseMessage ResponseClass=\"Error\">"
+                 "<m:ResponseCode>ErrorFolderNotFound</m:ResponseCode>"
+                 "</m:FindItemResponseMessage>"));
+    queue_find_item("");
+
+    recording_sink sink;
+    sink.skip_failed_folders = true;
+    ews::basic_mailbox_exporter<http_request_mock> exporter(service());
+    const auto stats = exporter.run(inbox(), sink);
+
+    ASSERT_EQ(1U, sink.failed_folders.size());
+    EXPECT_EQ("inbox", sink.failed_folders[0]);
+    EXPECT_EQ(1U, stats.folders);
+    ASSERT_FALSE(sink.checkpoints.empty());
+    EXPECT_EQ("done f1\n", sink.checkpoints.back());
+
+    queue_hierarchy();
+    queue_fake_response(
+        200, make_response_envelope(
+                 "FindItem",
+                 "<m:FindItemResponseMessage ResponseClass=\"Error\">"
+                 "<m:ResponseCode>ErrorFolderNotFound</m:ResponseCode>"
+                 "</m:FindItemResponseMessage>"));
+    recording_sink aborting;
+    EXPECT_THROW(exporter.run(inbox(), aborting), ews::exchange_error);
+}
+
+TEST_F(MailboxExportTest, ResumesFromCheckpoint)
+{
+    queue_hierarchy();
+    queue_find_item("");
+
+    recording_sink sink;
+    ews::basic_mailbox_exporter<http_request_mock> exporter(service());
+    const auto from =
+        ews::export_checkpoint::from_string("done inbox\nat 7 f1\n");
+    const auto stats = exporter.run(inbox(), sink, from);
+    EXPECT_EQ(1U, stats.folders);
+    EXPECT_TRUE(sink.items.empty());
+    EXPECT_NE(get_last_request().request_string().find("Offset=\"7\""),
+              std::string::npos);
+    EXPECT_NE(get_last_request().request_string().find(
+                  "<t:FolderId Id=\"f1\"/>"),
+              std::string::npos);
+}
+
+TEST(ExportCheckpointTest, RoundTripsThroughString)
+{
+    const auto cp =
+        ews::export_checkpoint::from_string("done a\ndone b\nat 42 c d\n");
+    EXPECT_TRUE(cp.is_completed(ews::folder_id("a")));
+    EXPECT_TRUE(cp.is_completed(ews::folder_id("b")));
+    EXPECT_FALSE(cp.is_completed(ews::folder_id("c d")));
+    EXPECT_EQ("c d", cp.current_folder());
+    EXPECT_EQ(42U, cp.current_offset());
+    EXPECT_EQ("done a\ndone b\nat 42 c d\n", cp.to_string());
+    EXPECT_TRUE(ews::export_checkpoint().to_string().empty());
+}
+
+TEST(ExportCheckpointTest, RejectsGarbage)
+{
+    EXPECT_THROW(ews::export_checkpoint::from_string("at x f"),
+                 ews::exception);
+    EXPECT_THROW(ews::export_checkpoint::from_string("at 1"), ews::exception);
+    EXPECT_THROW(ews::export_checkpoint::from_string("hello"),
+                 ews::exception);
+}
+
+TEST(CancellationTokenTest, NotCancelledByDefault)
+{
+    ews::cancellation_token token;
+    EXPECT_FALSE(token.is_cancelled());
+    EXPECT_FALSE(token.has_deadline());
+    EXPECT_FALSE(token.deadline_exceeded());
+    EXPECT_EQ(0, token.time_left().count());
+}
+
+TEST(CancellationTokenTest, CopiesShareCancellation)
+{
+    ews::cancellation_token token;
+    auto copy = token;
+    copy.cancel();
+    EXPECT_TRUE(token.is_cancelled());
+    EXPECT_FALSE(token.deadline_exceeded());
+}
+
+TEST(CancellationTokenTest, DeadlineCancelsToken)
+{
+    ews::cancellation_token far(std::chrono::milliseconds(60000));
+    EXPECT_FALSE(far.is_cancelled());
+    EXPECT_TRUE(far.has_deadline());
+    EXPECT_GT(far.time_left().count(), 59000);
+
+    ews::cancellation_token past(std::chrono::milliseconds(0));
+    EXPECT_TRUE(past.is_cancelled());
+    EXPECT_TRUE(past.deadline_exceeded());
+}
+
+TEST(CancellationTokenTest, LinkedTokenFollowsParent)
+{
+    ews::cancellation_token parent(std::chrono::milliseconds(60000));
+    auto child = parent.linked();
+    EXPECT_TRUE(child.has_deadline());
+
+    child.cancel();
+    EXPECT_TRUE(child.is_cancelled());
+    EXPECT_FALSE(parent.is_cancelled());
+
+    auto other = parent.linked();
+    parent.cancel();
+    EXPECT_TRUE(other.is_cancelled());
+}
+
+class HedgingTest : public RetryTest
+{
+};
+
+TEST_F(HedgingTest, OffByDefault)
+{
+    EXPECT_EQ(0, service().get_hedging_delay().count());
+    service().set_async_engine(engine());
+    service().get_calendar_item(ews::item_id("abc"));
+    EXPECT_EQ(0U, http_request_mock::storage::instance().async_requests);
+}
+
+TEST_F(HedgingTest, AnsweredRequestIsSentOnce)
+{
+    service().set_async_engine(engine());
+    service().set_hedging_delay(std::chrono::milliseconds(1000));
+    const auto item = service().get_calendar_item(ews::item_id("abc"));
+    EXPECT_EQ("Retried", item.get_subject());
+    EXPECT_EQ(1U, http_request_mock::storage::instance().async_requests);
+}
+
+TEST_F(HedgingTest, SlowReadIsSentAgain)
+{
+    auto& storage = http_request_mock::storage::instance();
+    storage.unanswered_async_requests = 1U;
+    service().set_async_engine(engine());
+    service().set_hedging_delay(std::chrono::milliseconds(1));
+    const auto item = service().get_calendar_item(ews::item_id("abc"));
+    EXPECT_EQ("Retried", item.get_subject());
+    EXPECT_EQ(2U, storage.async_requests);
+}
+
+TEST_F(HedgingTest, WritesAreNotHedged)
+{
+    service().set_async_engine(engine());
+    service().set_hedging_delay(std::chrono::milliseconds(1));
+    set_next_fake_response_message(
+        "DeleteItem", "<m:DeleteItemResponseMessage ResponseClass=\"Success\">"
+                      "<m:ResponseCode>NoError</m:ResponseCode>"
+                      "</m:DeleteItemResponseMessage>");
+    service().delete_item(ews::item_id("abc"));
+    EXPECT_EQ(0U, http_request_mock::storage::instance().async_requests);
+}
+
+TEST_F(HedgingTest, RestoresCancellationToken)
+{
+    auto& storage = http_request_mock::storage::instance();
+    service().set_async_engine(engine());
+    service().set_hedging_delay(std::chrono::milliseconds(1000));
+    service().get_calendar_item(ews::item_id("abc"));
+    EXPECT_FALSE(storage.has_cancellation_token);
+
+    service().set_cancellation_token(ews::cancellation_token());
+    service().get_calendar_item(ews::item_id("abc"));
+    EXPECT_TRUE(storage.has_cancellation_token);
+
+    service().reset_cancellation_token();
+    EXPECT_FALSE(storage.has_cancellation_token);
+}
+
+class ReplayTest : public AsyncServiceTest
+{
+public:
+    void SetUp()
+    {
+        AsyncServiceTest::SetUp();
+        set_next_fake_response_message(
+            "GetItem", "<m:GetItemResponseMessage ResponseClass=\"Success\">"
+                       "<m:ResponseCode>NoError</m:ResponseCode>"
+                       "<m:Items><t:CalendarItem>"
+                       "<t:ItemId Id=\"abc\" ChangeKey=\"ck\"/>"
+                       "<t:Subject>Recorded</t:Subject>"
+                       "</t:CalendarItem></m:Items>"
+                       "</m:GetItemResponseMessage>");
+        log_ = std::make_shared<ews::replay_log>();
+        ews::replay_log::install(url(), log_);
+    }
+
+    void TearDown()
+    {
+        ews::replay_log::uninstall(url());
+        log_.reset();
+        AsyncServiceTest::TearDown();
+    }
+
+    static std::string url() { return "https://example.com/ews/replay.asmx"; }
+
+    ews::replay_log& log() { return *log_; }
+
+    // Sends a GetItem request through a recording handler
+    void record_get_item(const std::string& id)
+    {
+        ews::basic_service<
+            ews::basic_recording_request_handler<http_request_mock>>
+            recorder(url(), "FAKEDOMAIN", "fakeuser", "fakepassword");
+        recorder.get_calendar_item(ews::item_id(id));
+    }
+
+private:
+    std::shared_ptr<ews::replay_log> log_;
+};
+
+TEST_F(ReplayTest, ReplaysRecordedResponse)
+{
+    record_get_item("abc");
+    ASSERT_EQ(1U, log().size());
+    EXPECT_EQ(200L, log().at(0U)->code);
+    EXPECT_EQ("GetItem", ews::replay_log::operation_of(log().at(0U)->request));
+
+    set_next_fake_response("");
+    ews::basic_service<ews::replay_request_handler> replayed(
+        url(), "FAKEDOMAIN", "fakeuser", "fakepassword");
+    const auto item = replayed.get_calendar_item(ews::item_id("abc"));
+    EXPECT_EQ("Recorded", item.get_subject());
+}
+
+TEST_F(ReplayTest, FallsBackToSameOperation)
+{
+    record_get_item("abc");
+    ews::basic_service<ews::replay_request_handler> replayed(
+        url(), "FAKEDOMAIN", "fakeuser", "fakepassword");
+    EXPECT_EQ("Recorded",
+              replayed.get_calendar_item(ews::item_id("xyz")).get_subject());
+    EXPECT_THROW(replayed.delete_item(ews::item_id("abc")), ews::exception);
+
+    ews::replay_options options;
+    options.strict = true;
+    log().set_options(options);
+    EXPECT_THROW(replayed.get_calendar_item(ews::item_id("xyz")),
+                 ews::exception);
+}
+
+TEST_F(ReplayTest, SavedLogCanBeLoaded)
+{
+    record_get_item("abc");
+    record_get_item("def");
+    std::stringstream sstr;
+    log().save(sstr);
+
+    ews::replay_log loaded;
+    loaded.load(sstr);
+    ASSERT_EQ(2U, loaded.size());
+    for (std::size_t i = 0U; i < loaded.size(); ++i)
+    {
+        EXPECT_EQ(log().at(i)->request, loaded.at(i)->request);
+        EXPECT_EQ(log().at(i)->code, loaded.at(i)->code);
+        EXPECT_EQ(log().at(i)->response, loaded.at(i)->response);
+    }
+
+    std::istringstream garbage("GET / HTTP/1.1\n");
+    EXPECT_THROW(loaded.load(garbage), ews::exception);
+}
+
+TEST_F(ReplayTest, RequiresInstalledLog)
+{
+    EXPECT_THROW(ews::replay_request_handler("https://example.com/other"),
+                 ews::exception);
+    EXPECT_THROW(
+        ews::recording_request_handler("https://example.com/other"),
+        ews::exception);
+}
+
+class FolderHierarchyTest : public AsyncServiceTest
+{
+public:
+    static std::string folder_xml(const std::string& id,
+                                  const std::string& parent,
+                                  const std::string& name)
+    {
+        return "<t:Folder><t:FolderId Id=\"" + id +
+               "\" ChangeKey=\"ck\"/><t:ParentFolderId Id=\"" + parent +
+               "\"/><t:FolderClass>IPF.Note</t:FolderClass>"
+               "<t:DisplayName>" +
+               name + "</t:DisplayName><t:TotalCount>3</t:TotalCount>"
+                      "<t:ChildFolderCount>0</t:ChildFolderCount>"
+                      "</t:Folder>";
+    }
+
+    void queue_get_folder(const std::vector<std::string>& folders)
+    {
+        std::string messages;
+        for (const auto& f : folders)
+        {
+            messages += f.empty()
+                            ? "<m:GetFolderResponseMessage "
+                              "ResponseClass=\"Error\">"
+                              "<m:ResponseCode>ErrorItemNotFound"
+                              "</m:ResponseCode>"
+                              "</m:GetFolderResponseMessage>"
+                            : "<m:GetFolderResponseMessage "
+                              "ResponseClass=\"Success\">"
+                              "<m:ResponseCode>NoError</m:ResponseCode>"
+                              "<m:Folders>" +
+                                  f +
+                                  "</m:Folders>"
+                                  "</m:GetFolderResponseMessage>";
+        }
+        queue_fake_response(200,
+                            make_response_envelope("GetFolder", messages));
+    }
+
+    void queue_sync(const std::string& state, const std::string& changes)
+    {
+        queue_fake_response(
+            200,
+            make_response_envelope(
+                "SyncFolderHierarchy",
+                "<m:SyncFolderHierarchyResponseMessage "
+                "ResponseClass=\"Success\">"
+                "<m:ResponseCode>NoError</m:ResponseCode>"
+                "<m:SyncState>" +
+                    state +
+                    "</m:SyncState>"
+                    "<m:IncludesLastFolderInRange>true"
+                    "</m:IncludesLastFolderInRange>"
+                    "<m:Changes>" +
+                    changes + "</m:Changes>"
+                              "</m:SyncFolderHierarchyResponseMessage>"));
+    }
+
+    static std::string created(const std::string& id)
+    {
+        return "<t:Create><t:Folder><t:FolderId Id=\"" + id +
+               "\"/></t:Folder></t:Create>";
+    }
+
+    // Loads a hierarchy of Inbox (f1), Inbox/Projects (f2) and Archive
+    // (f3) into given resolver
+    void load(ews::basic_folder_resolver<http_request_mock>& resolver)
+    {
+        queue_get_folder({folder_xml("root", "top", "Top")});
+        queue_sync("h1", created("f1") + created("f2") + created("f3"));
+        queue_get_folder({folder_xml("f1", "root", "Inbox"),
+                          folder_xml("f2", "f1", "Projects"),
+                          folder_xml("f3", "root", "Archive")});
+        resolver.refresh();
+        ASSERT_EQ(0U, queued_fake_responses());
+    }
+};
+
+TEST_F(FolderHierarchyTest, FindFolderPagesThroughAllFolders)
+{
+    auto page = [](const std::string& attributes, const std::string& folders) {
+        return make_response_envelope(
+            "FindFolder",
+            "<m:FindFolderResponseMessage ResponseClass=\"Success\">"
+            "<m:ResponseCode>NoError</m:ResponseCode>"
+            "<m:RootFolder " +
+                attributes + "><t:Folders>" + folders +
+                "</t:Folders></m:RootFolder>"
+                "</m:FindFolderResponseMessage>");
+    };
+    queue_fake_response(
+        200, page("IndexedPagingOffset=\"1\" TotalItemsInView=\"2\" "
+                  "IncludesLastItemInRange=\"false\"",
+                  folder_xml("f1", "root", "Inbox")));
+    queue_fake_response(
+        200, page("IndexedPagingOffset=\"2\" TotalItemsInView=\"2\" "
+                  "IncludesLastItemInRange=\"true\"",
+                  "<t:CalendarFolder><t:FolderId Id=\"f2\"/>"
+                  "<t:DisplayName>Calendar</t:DisplayName>"
+                  "</t:CalendarFolder>"));
+
+    const auto folders = service().find_folder(
+        ews::distinguished_folder_id(ews::standard_folder::msg_folder_root),
+        ews::folder_traversal::deep, 1U);
+    ASSERT_EQ(2U, folders.size());
+    EXPECT_EQ("f1", folders[0].get_folder_id().id());
+    EXPECT_EQ("root", folders[0].get_parent_folder_id().id());
+    EXPECT_EQ("Inbox", folders[0].get_display_name());
+    EXPECT_EQ("IPF.Note", folders[0].get_folder_class());
+    EXPECT_EQ(3U, folders[0].get_total_count());
+    EXPECT_EQ("Calendar", folders[1].get_display_name());
+    EXPECT_FALSE(folders[1].get_parent_folder_id().valid());
+
+    const auto& req = get_last_request().request_string();
+    EXPECT_NE(req.find("<m:FindFolder Traversal=\"Deep\">"), std::string::npos);
+    EXPECT_NE(req.find("<m:IndexedPageFolderView MaxEntriesReturned=\"1\" "
+                       "Offset=\"1\""),
+              std::string::npos);
+    EXPECT_THROW(service().find_folder(ews::folder_id("f1"),
+                                       ews::folder_traversal::shallow, 0U),
+                 ews::exception);
+}
+
+TEST_F(FolderHierarchyTest, GetFoldersReturnsOneResultPerId)
+{
+    queue_get_folder({folder_xml("f1", "root", "Inbox"), ""});
+    queue_get_folder({folder_xml("f3", "root", "Archive")});
+
+    ews::batch_options options;
+    options.chunk_size = 2U;
+    const auto results = service().get_folders(
+        {ews::folder_id("f1"), ews::folder_id("f2"), ews::folder_id("f3")},
+        options);
+    ASSERT_EQ(3U, results.size());
+    EXPECT_TRUE(results[0].success());
+    EXPECT_EQ("Inbox", results[0].get_item().get_display_name());
+    EXPECT_FALSE(results[1].success());
+    EXPECT_EQ(ews::response_code::error_item_not_found,
+              results[1].get_response_code());
+    EXPECT_EQ("Archive", results[2].get_item().get_display_name());
+
+    const auto& req = get_last_request().request_string();
+    EXPECT_NE(req.find("<t:FieldURI FieldURI=\"folder:ParentFolderId\"/>"),
+              std::string::npos);
+}
+
+TEST_F(FolderHierarchyTest, ResolverAnswersKnownPathsFromCache)
+{
+    ews::basic_folder_resolver<http_request_mock> resolver(service());
+    load(resolver);
+    EXPECT_EQ(3U, resolver.size());
+    EXPECT_EQ("h1", resolver.sync_state());
+
+    // Any request would fail from now on
+    set_next_fake_response("");
+    EXPECT_EQ("f2", resolver.resolve("Inbox/Projects").id());
+    EXPECT_EQ("f2", resolver.resolve("/Inbox/Projects/").id());
+    EXPECT_EQ("f3", resolver.resolve("Archive").id());
+    EXPECT_EQ("root", resolver.resolve("").id());
+}
+
+TEST_F(FolderHierarchyTest, ResolverSyncsChangesOnMiss)
+{
+    ews::basic_folder_resolver<http_request_mock> resolver(service());
+    load(resolver);
+
+    queue_sync("h2", created("f4"));
+    queue_get_folder({folder_xml("f4", "f2", "2017")});
+    EXPECT_EQ("f4", resolver.resolve("Inbox/Projects/2017").id());
+    EXPECT_EQ("h2", resolver.sync_state());
+    EXPECT_NE(
+        get_last_request().request_string().find("<t:FolderId Id=\"f4\"/>"),
+        std::string::npos);
+
+    queue_sync("h3", "<t:Delete><t:FolderId Id=\"f3\"/></t:Delete>");
+    resolver.refresh();
+    queue_sync("h4", "");
+    EXPECT_THROW(resolver.resolve("Archive"), ews::exception);
+    EXPECT_EQ(0U, queued_fake_responses());
+    EXPECT_EQ(3U, resolver.size());
 }
 }
 
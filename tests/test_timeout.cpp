@@ -54,6 +54,24 @@ TEST_F(TimeoutTest, ReachTimeout)
     EXPECT_TRUE(reached_timeout);
 }
 
+TEST_F(TimeoutTest, ReachTimeoutInMilliseconds)
+{
+    timeout_test::start(assets());
+    bool reached_timeout = false;
+    try
+    {
+        ews::internal::http_request r("http://127.0.0.1:8080/");
+        r.set_timeout(std::chrono::milliseconds(300));
+
+        r.send("");
+    }
+    catch (std::exception&)
+    {
+        reached_timeout = true;
+    }
+    EXPECT_TRUE(reached_timeout);
+}
+
 TEST_F(TimeoutTest, NotReachTimeout)
 {
     timeout_test::start(assets());